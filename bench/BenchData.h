@@ -0,0 +1,46 @@
+#pragma once
+
+// Input grids of the benchmarks
+
+#include <QtGui>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// Points of a text file with one "x y z" line per point
+inline bool readPoints(const QString &filename, std::vector<QVector3D> &points)
+{
+    FILE *file = std::fopen(filename.toLocal8Bit().constData(), "r");
+    if (!file)
+        return false;
+
+    double x, y, z;
+    while (std::fscanf(file, "%lf %lf %lf", &x, &y, &z) == 3)
+        points.push_back(QVector3D(x, y, z));
+    std::fclose(file);
+    return true;
+}
+
+// Smooth n x n grid listed row by row, one unit between the vertices
+inline void syntheticPoints(unsigned int n, std::vector<QVector3D> &points)
+{
+    points.reserve((size_t)n * n);
+    for (unsigned int row = 0; row < n; row++)
+        for (unsigned int col = 0; col < n; col++)
+            points.push_back(QVector3D(col, row, 100 * std::sin(col * 0.05) * std::cos(row * 0.03)));
+}
+
+// The triangles of ThreeDObject grids: each cell split along the diagonal
+// from its first corner, as HeightfieldMesh splits them
+inline void gridPolygons(unsigned int rows, unsigned int cols, std::vector<std::vector<unsigned int>> &polygons)
+{
+    polygons.reserve(2 * (size_t)(rows - 1) * (cols - 1));
+    for (unsigned int row = 1; row < rows; row++)
+    {
+        for (unsigned int col = 1; col < cols; col++)
+        {
+            polygons.push_back({(row - 1) * cols + (col - 1), (row - 1) * cols + col, row * cols + col});
+            polygons.push_back({(row - 1) * cols + (col - 1), row * cols + col, row * cols + (col - 1)});
+        }
+    }
+}
@@ -0,0 +1,57 @@
+// Load-time benchmark of the half-edge builder (ThreeDObject::build)
+//
+// Usage: LoadBenchmark [data_dir] [max_grid_size]
+//   Loads every *.dat file in data_dir (default "data") and synthetic square
+//   grids of 512, 1024 and 2048 vertices per side (up to max_grid_size,
+//   default 2048). 4096 is left out by default, its build needs about 11 GB.
+
+#include <QtGui>
+#include <chrono>
+#include <cstdio>
+#include "BenchData.h"
+#include "ObjectRepresentation.h"
+
+static void run(const QString &name, const std::vector<QVector3D> &points)
+{
+    unsigned int n = std::sqrt(points.size());
+    std::vector<std::vector<unsigned int>> polygons;
+    gridPolygons(n, n, polygons);
+
+    auto start = std::chrono::steady_clock::now();
+    ThreeDObject object;
+    object.build(points, polygons, QColor(0, 0, 255));
+    auto end = std::chrono::steady_clock::now();
+
+    size_t unpaired = 0;
+    for (const Edge &edge : object.edges)
+        unpaired += edge.pair == nullptr;
+
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+    std::printf("%-24s %10zu %10zu %10zu %12.2f %10.1f\n", name.toLocal8Bit().constData(),
+                object.vertices.size(), object.faces.size(), unpaired, ms, 1e6 * ms / object.vertices.size());
+    std::fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    QString dataDir = argc > 1 ? argv[1] : "data";
+    unsigned int maxSize = argc > 2 ? std::atoi(argv[2]) : 2048;
+
+    std::printf("%-24s %10s %10s %10s %12s %10s\n", "input", "vertices", "faces", "boundary", "build [ms]", "ns/vertex");
+
+    QDir dir(dataDir);
+    for (const QString &file : dir.entryList(QStringList() << "*.dat", QDir::Files))
+    {
+        std::vector<QVector3D> points;
+        if (readPoints(dir.filePath(file), points))
+            run(file, points);
+    }
+
+    for (unsigned int n = 512; n <= maxSize; n *= 2)
+    {
+        std::vector<QVector3D> points;
+        syntheticPoints(n, points);
+        run(QString("synthetic %1x%1").arg(n), points);
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+// Throughput of the parallel .dat parser (DatParser)
+//
+// Usage: ParseBenchmark [data_dir] [megabytes] [max_threads]
+//   Repeats every *.dat file in data_dir (default "data") in memory until it
+//   is about megabytes large (default 1024) and parses it from memory with
+//   1, 2, 4, ... max_threads threads (default: hardware threads). The time of
+//   one pass counting the newlines is printed as a memory read reference.
+
+#include <QtCore>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include "DatParser.h"
+
+static bool readText(const QString &filename, std::string &text)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QByteArray bytes = file.readAll();
+    text.assign(bytes.constData(), bytes.size());
+    if (!text.empty() && text.back() != '\n')
+        text += '\n';
+    return true;
+}
+
+static double milliseconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void run(const QString &name, const std::string &sample, size_t megabytes, int maxThreads)
+{
+    std::string text;
+    text.reserve(megabytes << 20);
+    while (text.size() + sample.size() <= megabytes << 20 || text.empty())
+        text += sample;
+    double mb = text.size() / double(1 << 20);
+
+    auto start = std::chrono::steady_clock::now();
+    volatile size_t lines = std::count(text.begin(), text.end(), '\n');
+    double readMs = milliseconds(start);
+    std::printf("%s: %.0f MB, %zu lines, newline count %.1f ms (%.0f MB/s)\n", name.toLocal8Bit().constData(), mb,
+                (size_t)lines, readMs, mb / readMs * 1000);
+    std::printf("%8s %12s %10s %8s\n", "threads", "parse [ms]", "MB/s", "speedup");
+
+    double single = 0;
+    for (int threads = 1; threads <= maxThreads; threads = threads < maxThreads ? std::min(2 * threads, maxThreads) : threads + 1)
+    {
+        DatParser parser(threads);
+        std::vector<double> xyz;
+        double best = 0;
+        for (int repeat = 0; repeat < 3; repeat++)
+        {
+            start = std::chrono::steady_clock::now();
+            if (!parser.parse(text.data(), text.data() + text.size(), xyz))
+            {
+                std::printf("%s\n", parser.errorString().toLocal8Bit().constData());
+                return;
+            }
+            double ms = milliseconds(start);
+            best = repeat == 0 ? ms : std::min(best, ms);
+        }
+        if (threads == 1)
+            single = best;
+        std::printf("%8d %12.1f %10.0f %8.2f\n", threads, best, mb / best * 1000, single / best);
+        std::fflush(stdout);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QString dataDir = argc > 1 ? argv[1] : "data";
+    size_t megabytes = argc > 2 ? std::atoi(argv[2]) : 1024;
+    int maxThreads = argc > 3 ? std::atoi(argv[3]) : std::max(1u, std::thread::hardware_concurrency());
+
+    QDir dir(dataDir);
+    for (const QString &file : dir.entryList(QStringList() << "*.dat", QDir::Files))
+    {
+        std::string sample;
+        if (readText(dir.filePath(file), sample) && !sample.empty())
+            run(file, sample, megabytes, maxThreads);
+    }
+    return 0;
+}
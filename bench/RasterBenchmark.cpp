@@ -0,0 +1,84 @@
+// Fill-rate benchmark of the triangle rasterizers
+//
+// Usage: RasterBenchmark [triangles] [image_size]
+//   Draws the same random triangles (default 20000) into a square image
+//   (default 1024) with the legacy scanline fill and with the edge-function
+//   rasterizer, for flat (SIDE) and interpolated (VERTEX) colors and a few
+//   triangle sizes. Pixel counts are the pixels covered by the triangles.
+
+#include <QtGui>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include "Renderer.h"
+
+// Flat triangles share one color, like faces drawn with SIDE coloring
+static std::vector<std::array<Vertex, 3>> randomTriangles(size_t count, int image_size, double triangle_size, bool flat)
+{
+    std::mt19937 random(42);
+    std::uniform_real_distribution<double> position(10 + triangle_size, image_size - 10 - triangle_size);
+    std::uniform_real_distribution<double> offset(-triangle_size, triangle_size);
+    std::uniform_real_distribution<double> depth(-100, 100);
+    std::uniform_int_distribution<int> channel(0, 255);
+
+    std::vector<std::array<Vertex, 3>> triangles(count);
+    for (std::array<Vertex, 3> &triangle : triangles)
+    {
+        double cx = position(random), cy = position(random);
+        QRgb color = qRgb(channel(random), channel(random), channel(random));
+        for (Vertex &vertex : triangle)
+        {
+            vertex.x = cx + offset(random);
+            vertex.y = cy + offset(random);
+            vertex.z = depth(random);
+            vertex.color = flat ? color : qRgb(channel(random), channel(random), channel(random));
+        }
+    }
+    return triangles;
+}
+
+static void run(Renderer &renderer, const char *name, Renderer::RasterizationAlgorithm algorithm,
+                Renderer::ColoringType coloring, double triangle_size,
+                const std::vector<std::array<Vertex, 3>> &triangles, size_t pixels)
+{
+    Renderer::SceneState scene;
+    scene.rasterizationAlgorithm = algorithm;
+    renderer.beginFrame(scene);
+
+    auto start = std::chrono::steady_clock::now();
+    for (const std::array<Vertex, 3> &triangle : triangles)
+        renderer.drawTriangle(triangle, coloring);
+    auto end = std::chrono::steady_clock::now();
+
+    double s = std::chrono::duration<double>(end - start).count();
+    std::printf("%-16s %-8s %6.0f %10.2f %14.0f %14.0f\n", name, coloring == Renderer::SIDE ? "SIDE" : "VERTEX",
+                triangle_size, 1e3 * s, triangles.size() / s, pixels / s);
+    std::fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t count = argc > 1 ? std::atoi(argv[1]) : 20000;
+    int size = argc > 2 ? std::atoi(argv[2]) : 1024;
+
+    Renderer renderer(QSize(size, size));
+
+    std::printf("%-16s %-8s %6s %10s %14s %14s\n", "rasterizer", "coloring", "size", "time [ms]", "triangles/s", "pixels/s");
+
+    for (double triangle_size : {4.0, 16.0, 64.0})
+    {
+        for (Renderer::ColoringType coloring : {Renderer::SIDE, Renderer::VERTEX})
+        {
+            std::vector<std::array<Vertex, 3>> triangles =
+                randomTriangles(count, size, triangle_size, coloring == Renderer::SIDE);
+
+            size_t pixels = 0;
+            for (const std::array<Vertex, 3> &triangle : triangles)
+                pixels += renderer.rasterizeTriangle(triangle);
+
+            run(renderer, "scanline (DDA)", Renderer::DDA, coloring, triangle_size, triangles, pixels);
+            run(renderer, "edge function", Renderer::EDGE_FUNCTION, coloring, triangle_size, triangles, pixels);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,447 @@
+// Micro-benchmarks of the rendering and loading stages, written as JSON
+//
+// Usage: StageBenchmark [data_dir] [max_grid_size] [output.json]
+//   Runs every stage on each *.dat grid in data_dir (default "data") and on
+//   synthetic square grids of 129, 257, 513 and 1025 vertices per side (up
+//   to max_grid_size). The terrain is fitted to a 1024x1024 image as the
+//   loaders do and seen from 30 degrees above the horizon:
+//     Dda, Bresenhamm   every edge of the mesh
+//     fillTriangle      every face
+//     fillPolygon       every grid cell, as a quad
+//     clipPolygon       every face, enlarged 3x around the middle of the
+//                       image so that many cross its border
+//     updateNormals     face and vertex normals of the whole mesh
+//     calculateColors   all faces (SIDE) or all vertices (VERTEX), the
+//                       normals kept from the frame before
+//     loadObject        the whole grid, one op per vertex
+//   These are the stages of ThreeDObject meshes. The viewer draws grids as a
+//   HeightfieldMesh instead, which the "grid" stages time on the same inputs:
+//     DemFile::open     the .dat parsed and its cache written, or the cache
+//                       mapped (data_dir files only)
+//     loadHeightfield   the HeightGrid of the DemFile fitted and colored
+//     grid ...          the stages of Renderer::render(), as timed by its
+//                       FrameProfiler, at full resolution without occlusion
+//                       culling; fill with the scanline (DDA) and the tiled
+//                       edge-function rasterizer
+//   A stage is repeated for at least MIN_SECONDS and its fastest run kept.
+//   The results (ns per op, pixels/s of the stages that draw and the heap
+//   allocations of one run) are printed and written to output.json (default
+//   "stage_benchmark.json") to compare builds. Pixels are counted with the
+//   edge-function rasterizer, the scanline fills cover about as many.
+
+#include <QtGui>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include "BenchData.h"
+#include "DemFile.h"
+#include "Renderer.h"
+
+// Heap allocations, counted by replacing the global operator new (QImage
+// pixels are malloc'ed and not counted)
+static std::atomic<size_t> allocation_count(0), allocated_bytes(0);
+
+void *operator new(std::size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept { std::free(pointer); }
+
+static const int IMAGE_SIZE = 1024;
+static const double MIN_SECONDS = 0.2;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Measurement
+{
+    double seconds = std::numeric_limits<double>::max(); // fastest run
+    size_t allocations = 0, bytes = 0;                   // of that run
+    bool counted = true; // false for the stages of a frame, only the frame counts them
+};
+
+struct Result
+{
+    QString stage, input, op;
+    size_t vertices, ops;
+    double pixels; // drawn by one run, 0 for stages that do not draw
+    Measurement run;
+};
+
+// Fastest of repeated runs of work; reset runs untimed before each
+template <class Reset, class Work>
+static Measurement measure(Reset reset, Work work)
+{
+    Measurement best;
+    double total = 0;
+    for (int runs = 0; total < MIN_SECONDS || (runs < 3 && total < 5 * MIN_SECONDS); runs++)
+    {
+        reset();
+        size_t allocations = allocation_count, bytes = allocated_bytes;
+        Clock::time_point start = Clock::now();
+        work();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        total += seconds;
+        if (seconds < best.seconds)
+            best = {seconds, allocation_count - allocations, allocated_bytes - bytes};
+    }
+    return best;
+}
+
+// Centered and scaled to half the image, as Renderer::loadObject() does
+static void fitObject(ThreeDObject &object)
+{
+    QVector3D min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    QVector3D max = -min;
+    for (const Vertex &vertex : object.vertices)
+    {
+        QVector3D point = vertex.toVector3D();
+        for (int i = 0; i < 3; i++)
+        {
+            min[i] = std::min(min[i], point[i]);
+            max[i] = std::max(max[i], point[i]);
+        }
+    }
+
+    QVector3D size = max - min + QVector3D(1, 1, 1) * std::numeric_limits<float>::min();
+    double scale = 0.5 * IMAGE_SIZE / std::max(size.x(), size.y());
+    object.translate(-(min + max) / 2);
+    object.scale(scale);
+    object.scaleZ(0.5 * IMAGE_SIZE / size.z() / scale);
+}
+
+static Renderer::SceneState benchmarkScene()
+{
+    Renderer::SceneState scene;
+    scene.globalColor = Qt::blue;
+    scene.rasterizationAlgorithm = Renderer::DDA;
+    scene.coloringType = Renderer::VERTEX;
+    scene.camera = {QVector3D(0, 0, 0), qDegreesToRadians(30.0), 0, 0};
+    scene.lightSource.position = QVector3D(0, -200, 200);
+    scene.lightSource.color = Qt::white;
+    scene.lightSource.intensity = 50;
+    scene.lightModel.ambient_color = Qt::white;
+    scene.lightModel.ambient = scene.lightModel.diffuse = scene.lightModel.specular = QVector3D(0.5, 0.5, 0.5);
+    scene.lightModel.specular_sharpness = 1;
+    return scene;
+}
+
+static void report(std::vector<Result> &results, const QString &stage, const QString &input, const QString &op,
+                   size_t vertices, size_t ops, double pixels, const Measurement &run)
+{
+    results.push_back({stage, input, op, vertices, ops, pixels, run});
+    QString rate = pixels > 0 ? QString::number(pixels / run.seconds / 1e6, 'f', 1) : "-";
+    QString allocations = run.counted ? QString::number(run.allocations) : "-";
+    std::printf("%-32s %-22s %-8s %10zu %10.1f %12s %12s\n", stage.toLocal8Bit().constData(),
+                input.toLocal8Bit().constData(), op.toLocal8Bit().constData(), ops, 1e9 * run.seconds / ops,
+                rate.toLocal8Bit().constData(), allocations.toLocal8Bit().constData());
+    std::fflush(stdout);
+}
+
+static void run(Renderer &renderer, const QString &name, const std::vector<QVector3D> &points, std::vector<Result> &results)
+{
+    // A row ends where y changes
+    unsigned int cols = 1;
+    while (cols < points.size() && points[cols].y() == points[0].y())
+        cols++;
+    unsigned int rows = points.size() / cols;
+    if (rows < 2 || cols < 2 || (size_t)rows * cols != points.size())
+    {
+        std::printf("%s: not a grid listed row by row, skipped\n", name.toLocal8Bit().constData());
+        return;
+    }
+    std::vector<std::vector<unsigned int>> polygons;
+    gridPolygons(rows, cols, polygons);
+    auto nothing = [] {};
+
+    Measurement load = measure(nothing, [&] { renderer.loadObject(points, polygons); });
+    report(results, "loadObject", name, "vertex", points.size(), points.size(), 0, load);
+
+    ThreeDObject object;
+    object.build(points, polygons, Qt::blue);
+    fitObject(object);
+
+    // The mesh in screen coordinates, as the drawing stages get it
+    Renderer::SceneState scene = benchmarkScene();
+    const Camera &camera = scene.camera;
+    renderer.beginFrame(scene);
+    renderer.drawObject(object, camera, scene.lightSource, Renderer::VERTEX); // sizes the render buffers
+    QMatrix4x4 transform = renderer.projectionMatrix(camera) * renderer.viewMatrix(camera) * renderer.modelMatrix();
+    std::vector<Vertex> screen(object.vertices.size());
+    for (const Vertex &vertex : object.vertices)
+    {
+        QVector3D point = transform.map(vertex.toVector3D());
+        Vertex &projected = screen[vertex.index];
+        projected.x = point.x();
+        projected.y = point.y();
+        projected.z = point.z();
+        projected.color = qRgb(vertex.index % 256, (vertex.index / 256) % 256, 128);
+    }
+    auto clear = [&] { renderer.beginFrame(scene); };
+
+    // Lines, every edge once
+    std::vector<std::pair<const Vertex *, const Vertex *>> lines;
+    double line_pixels = 0;
+    for (const Edge &edge : object.edges)
+    {
+        if (edge.pair && edge.pair->origin < edge.origin)
+            continue;
+        const Vertex &start = screen[edge.origin->index], &end = screen[edge.next->origin->index];
+        lines.push_back({&start, &end});
+        line_pixels += std::max(std::fabs(std::round(end.x) - std::round(start.x)),
+                                std::fabs(std::round(end.y) - std::round(start.y))) + 1;
+    }
+    Measurement dda = measure(clear, [&] {
+        for (const auto &line : lines)
+            renderer.Dda(*line.first, *line.second);
+    });
+    report(results, "Dda", name, "line", points.size(), lines.size(), line_pixels, dda);
+    Measurement bresenham = measure(clear, [&] {
+        for (const auto &line : lines)
+            renderer.Bresenhamm(*line.first, *line.second);
+    });
+    report(results, "Bresenhamm", name, "line", points.size(), lines.size(), line_pixels, bresenham);
+
+    // Triangles, the faces
+    std::vector<std::array<Vertex, 3>> triangles;
+    triangles.reserve(object.faces.size());
+    for (const Face &face : object.faces)
+    {
+        const Edge *edge = face.edge;
+        triangles.push_back({screen[edge->origin->index], screen[edge->next->origin->index],
+                             screen[edge->next->next->origin->index]});
+    }
+    double triangle_pixels = 0;
+    renderer.beginFrame(scene);
+    for (const std::array<Vertex, 3> &triangle : triangles)
+        triangle_pixels += renderer.rasterizeTriangle(triangle);
+    Measurement fill_triangle = measure(clear, [&] {
+        for (const std::array<Vertex, 3> &triangle : triangles)
+            renderer.fillTriangle(triangle);
+    });
+    report(results, "fillTriangle", name, "triangle", points.size(), triangles.size(), triangle_pixels, fill_triangle);
+
+    // Quads, the grid cells
+    std::vector<std::list<Vertex>> quads;
+    quads.reserve((size_t)(rows - 1) * (cols - 1));
+    double quad_pixels = 0;
+    renderer.beginFrame(scene);
+    for (unsigned int row = 1; row < rows; row++)
+    {
+        for (unsigned int col = 1; col < cols; col++)
+        {
+            const Vertex &a = screen[(row - 1) * cols + (col - 1)], &b = screen[(row - 1) * cols + col],
+                         &c = screen[row * cols + col], &d = screen[row * cols + (col - 1)];
+            quads.push_back({a, b, c, d});
+            quad_pixels += renderer.rasterizeTriangle({a, b, c}) + renderer.rasterizeTriangle({a, c, d});
+        }
+    }
+    Measurement fill_polygon = measure(clear, [&] {
+        for (const std::list<Vertex> &quad : quads)
+            renderer.fillPolygon(quad);
+    });
+    report(results, "fillPolygon", name, "quad", points.size(), quads.size(), quad_pixels, fill_polygon);
+
+    // Clipping, the clipped polygons are discarded
+    std::vector<std::list<Vertex>> enlarged, clipped;
+    enlarged.reserve(triangles.size());
+    for (const std::array<Vertex, 3> &triangle : triangles)
+    {
+        std::list<Vertex> polygon;
+        for (Vertex vertex : triangle)
+        {
+            vertex.x = IMAGE_SIZE / 2 + 3 * (vertex.x - IMAGE_SIZE / 2);
+            vertex.y = IMAGE_SIZE / 2 + 3 * (vertex.y - IMAGE_SIZE / 2);
+            polygon.push_back(vertex);
+        }
+        enlarged.push_back(std::move(polygon));
+    }
+    Measurement clip = measure([&] { clipped = enlarged; }, [&] {
+        for (std::list<Vertex> &polygon : clipped)
+            renderer.clipPolygon(polygon);
+    });
+    report(results, "clipPolygon", name, "polygon", points.size(), enlarged.size(), 0, clip);
+
+    // Lighting
+    Lighting lighting = renderer.prepareLighting(renderer.viewMatrix(camera), scene.lightSource);
+    Measurement normals = measure([&] { renderer.invalidateNormals(); }, [&] { renderer.updateNormals(object); });
+    report(results, "updateNormals", name, "vertex", points.size(), object.vertices.size(), 0, normals);
+    Measurement side = measure(nothing, [&] { renderer.calculateColors(object, lighting, Renderer::SIDE); });
+    report(results, "calculateColors SIDE", name, "face", points.size(), object.faces.size(), 0, side);
+    Measurement vertex = measure(nothing, [&] { renderer.calculateColors(object, lighting, Renderer::VERTEX); });
+    report(results, "calculateColors VERTEX", name, "vertex", points.size(), object.vertices.size(), 0, vertex);
+}
+
+// Fastest time of every stage of rendering scene again and again, with the
+// stage caching off so that each frame runs them all. The stages are the
+// fastest of their own and may come from different frames.
+static std::array<Measurement, FrameProfiler::STAGE_COUNT> measureFrames(Renderer &renderer,
+                                                                         const Renderer::SceneState &scene)
+{
+    FrameProfiler &profiler = renderer.profiler();
+    std::array<Measurement, FrameProfiler::STAGE_COUNT> stages;
+    for (Measurement &stage : stages)
+        stage.counted = false;
+
+    renderer.render(scene); // sizes the render buffers
+    stages[FrameProfiler::FRAME] = measure([&] { renderer.invalidateNormals(); }, [&] {
+        renderer.render(scene);
+        for (int stage = 0; stage < FrameProfiler::STAGE_COUNT; stage++)
+        {
+            double seconds = profiler.lastTime((FrameProfiler::Stage)stage) / 1e3;
+            if (stage != FrameProfiler::FRAME)
+                stages[stage].seconds = std::min(stages[stage].seconds, seconds);
+        }
+    });
+    return stages;
+}
+
+// The grid as the viewer draws it, see the usage above
+static void runHeightfield(Renderer &renderer, const QString &name, const HeightGrid &heights,
+                           std::vector<Result> &results)
+{
+    size_t vertices = (size_t)heights.rows * heights.cols;
+    size_t faces = 2 * (size_t)(heights.rows - 1) * (heights.cols - 1);
+    Measurement load = measure([] {}, [&] { renderer.loadHeightfield(heights); });
+    report(results, "loadHeightfield", name, "vertex", vertices, vertices, 0, load);
+
+    Renderer::SceneState scene = benchmarkScene();
+    scene.lod_tolerance = 0;
+    scene.occlusion_culling = false;
+    renderer.setStageCaching(false);
+    renderer.profiler().setEnabled(true);
+    for (Renderer::RasterizationAlgorithm algorithm : {Renderer::DDA, Renderer::EDGE_FUNCTION})
+    {
+        QString fill = algorithm == Renderer::DDA ? "scanline" : "edge function";
+        for (Renderer::ColoringType coloring : {Renderer::SIDE, Renderer::VERTEX})
+        {
+            scene.rasterizationAlgorithm = algorithm;
+            scene.coloringType = coloring;
+            QString type = coloring == Renderer::SIDE ? "SIDE" : "VERTEX";
+            std::array<Measurement, FrameProfiler::STAGE_COUNT> stages = measureFrames(renderer, scene);
+            size_t drawn = renderer.profiler().lastTriangles();
+            double pixels = renderer.profiler().lastPixels();
+
+            // Transforming and shading do not depend on the rasterizer
+            if (algorithm == Renderer::DDA)
+            {
+                if (coloring == Renderer::SIDE)
+                    report(results, "grid transform", name, "vertex", vertices, vertices, 0,
+                           stages[FrameProfiler::TRANSFORM]);
+                else
+                    report(results, "grid updateNormals", name, "vertex", vertices, vertices, 0,
+                           stages[FrameProfiler::NORMALS]);
+                report(results, "grid calculateColors " + type, name, coloring == Renderer::SIDE ? "face" : "vertex",
+                       vertices, coloring == Renderer::SIDE ? faces : vertices, 0, stages[FrameProfiler::SHADE]);
+            }
+            report(results, QString("grid fill %1 %2").arg(type).arg(fill), name, "triangle", vertices, drawn, pixels,
+                   stages[FrameProfiler::RASTERIZE]);
+            report(results, QString("grid frame %1 %2").arg(type).arg(fill), name, "frame", vertices, 1, pixels,
+                   stages[FrameProfiler::FRAME]);
+        }
+    }
+    renderer.profiler().setEnabled(false);
+    renderer.setStageCaching(true);
+}
+
+static bool writeJson(const QString &filename, const std::vector<Result> &results)
+{
+    QJsonArray array;
+    for (const Result &result : results)
+    {
+        QJsonObject object;
+        object["stage"] = result.stage;
+        object["input"] = result.input;
+        object["vertices"] = (qint64)result.vertices;
+        object["op"] = result.op;
+        object["ops"] = (qint64)result.ops;
+        object["ns_per_op"] = 1e9 * result.run.seconds / result.ops;
+        if (result.pixels > 0)
+            object["pixels_per_s"] = result.pixels / result.run.seconds;
+        if (result.run.counted)
+        {
+            object["allocations"] = (qint64)result.run.allocations;
+            object["allocated_bytes"] = (qint64)result.run.bytes;
+        }
+        array.append(object);
+    }
+
+    QJsonObject root;
+    root["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["image_size"] = IMAGE_SIZE;
+    root["results"] = array;
+
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    return file.write(QJsonDocument(root).toJson()) >= 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QString dataDir = argc > 1 ? argv[1] : "data";
+    unsigned int maxSize = argc > 2 ? std::atoi(argv[2]) : 1025;
+    QString output = argc > 3 ? argv[3] : "stage_benchmark.json";
+
+    Renderer renderer(QSize(IMAGE_SIZE, IMAGE_SIZE));
+    renderer.setGlobalColor(Qt::blue);
+    std::vector<Result> results;
+
+    std::printf("%-32s %-22s %-8s %10s %10s %12s %12s\n", "stage", "input", "op", "ops", "ns/op", "Mpixels/s",
+                "allocations");
+
+    QDir dir(dataDir);
+    for (const QString &file : dir.entryList(QStringList() << "*.dat", QDir::Files))
+    {
+        std::vector<QVector3D> points;
+        if (readPoints(dir.filePath(file), points))
+            run(renderer, file, points, results);
+
+        // The cache is removed before every parse and written again by it
+        QString path = dir.filePath(file);
+        DemFile dem;
+        Measurement parse = measure([&] { QFile::remove(DemFile::cachePath(path)); }, [&] { dem.open(path); });
+        if (!dem.open(path))
+        {
+            std::printf("%s: %s, skipped\n", file.toLocal8Bit().constData(), dem.errorString().toLocal8Bit().constData());
+            continue;
+        }
+        size_t vertices = (size_t)dem.rows() * dem.cols();
+        report(results, "DemFile::open text", file, "vertex", vertices, vertices, 0, parse);
+        Measurement mapped = measure([] {}, [&] { dem.open(path); });
+        report(results, "DemFile::open cache", file, "vertex", vertices, vertices, 0, mapped);
+        runHeightfield(renderer, file, dem.grid(), results);
+    }
+
+    for (unsigned int n = 129; n <= maxSize; n = 2 * n - 1)
+    {
+        std::vector<QVector3D> points;
+        syntheticPoints(n, points);
+        QString name = QString("synthetic %1x%1").arg(n);
+        run(renderer, name, points, results);
+
+        std::vector<float> z(points.size());
+        for (size_t i = 0; i < points.size(); i++)
+            z[i] = points[i].z();
+        HeightGrid heights;
+        heights.rows = heights.cols = n;
+        heights.samples = z.data();
+        heights.row_step = n;
+        runHeightfield(renderer, name, heights, results);
+    }
+
+    if (!writeJson(output, results))
+    {
+        std::fprintf(stderr, "Cannot write %s\n", output.toLocal8Bit().constData());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+// Thread scaling of the tiled edge-function rasterizer
+//
+// Usage: ThreadScalingBenchmark [dem.dat | grid_size] [max_threads] [image_size]
+//   Renders a DEM (default: a synthetic 2048x2048 grid) with SIDE and VERTEX
+//   coloring using 1, 2, 4, ... max_threads threads (default: hardware threads)
+//   and reports the average frame time and the speedup over one thread.
+//   Transformation and lighting stay single-threaded and are included, the
+//   renderer's stage caching is off so that every frame runs them.
+
+#include <QtWidgets>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include "BenchData.h"
+#include "DemFile.h"
+#include "ViewerWidget.h"
+
+static void setupScene(ViewerWidget &widget)
+{
+    widget.setZScale(1);
+    widget.setGlobalColor(Qt::blue);
+    widget.setLightColor(Qt::white);
+    widget.setLightPositionX(100);
+    widget.setLightPositionY(100);
+    widget.setLightPositionZ(300);
+    widget.setLightIntensity(150);
+    LightModel &model = widget.getLightModel();
+    model.ambient = QVector3D(0.3, 0.3, 0.3);
+    model.diffuse = QVector3D(0.6, 0.6, 0.6);
+    model.specular = QVector3D(0.4, 0.4, 0.4);
+    model.specular_sharpness = 5;
+    widget.setCamera(QVector3D(0, 0, 0), 0);
+    widget.setCameraRotation(0.6, 0.8);
+}
+
+// Average time of one frame in milliseconds
+static double frameTime(ViewerWidget &widget, int frames)
+{
+    widget.redraw(); // warm up, sizes the buffers and bins
+    widget.waitForFrame();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++)
+    {
+        // Waiting for every frame, requests made while rendering would be merged
+        widget.redraw();
+        widget.waitForFrame();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / frames;
+}
+
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+    int maxThreads = argc > 2 ? std::atoi(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+    int size = argc > 3 ? std::atoi(argv[3]) : 1024;
+
+    ViewerWidget widget(QSize(size, size));
+    widget.setStageCaching(false);
+    setupScene(widget);
+    widget.setRasterizationAlgorithm(Renderer::EDGE_FUNCTION);
+
+    DemFile dem;
+    int gridSize = argc > 1 ? std::atoi(argv[1]) : 2048;
+    int rows = gridSize, cols = gridSize;
+    if (argc > 1 && gridSize == 0)
+    {
+        if (!dem.open(argv[1]))
+        {
+            std::fprintf(stderr, "Cannot read %s: %s\n", argv[1], dem.errorString().toLocal8Bit().constData());
+            return 1;
+        }
+        widget.loadHeightfield(dem.grid());
+        rows = dem.rows();
+        cols = dem.cols();
+    }
+    else
+    {
+        std::vector<QVector3D> points;
+        syntheticPoints(gridSize, points);
+        widget.loadHeightfield(points, gridSize, gridSize);
+    }
+
+    std::printf("%dx%d grid, %dx%d image\n", rows, cols, size, size);
+    std::printf("%-8s %8s %12s %8s\n", "coloring", "threads", "frame [ms]", "speedup");
+
+    for (ViewerWidget::ColoringType coloring : {Renderer::SIDE, Renderer::VERTEX})
+    {
+        widget.setColoringType(coloring);
+        double single = 0;
+        for (int threads = 1;; threads = std::min(2 * threads, maxThreads))
+        {
+            widget.setThreadCount(threads);
+            double ms = frameTime(widget, 5);
+            if (threads == 1)
+                single = ms;
+            std::printf("%-8s %8d %12.2f %8.2f\n", coloring == Renderer::SIDE ? "SIDE" : "VERTEX", threads, ms, single / ms);
+            std::fflush(stdout);
+            if (threads >= maxThreads)
+                break;
+        }
+    }
+    return 0;
+}
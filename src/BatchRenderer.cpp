@@ -0,0 +1,123 @@
+#include "BatchRenderer.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include "WorkerPool.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+BatchRenderer::BatchRenderer(int render_threads, int save_threads)
+    : render_threads(render_threads > 0 ? render_threads : (int)std::max(1u, std::thread::hardware_concurrency())),
+      save_threads(std::max(1, save_threads))
+{
+}
+
+QString BatchRenderer::frameName(const QString &pattern, int frame)
+{
+    int first = pattern.indexOf('#');
+    if (first < 0)
+        return pattern;
+
+    int last = first;
+    while (last + 1 < pattern.size() && pattern[last + 1] == '#')
+        last++;
+    QString number = QString::number(frame).rightJustified(last - first + 1, '0');
+    return pattern.left(first) + number + pattern.mid(last + 1);
+}
+
+BatchStats BatchRenderer::render(const Renderer &source, const Renderer::SceneState &scene, const CameraPath &path,
+                                 const QString &pattern)
+{
+    Clock::time_point start = Clock::now();
+    BatchStats stats;
+    stats.frames = path.frameCount();
+    if (stats.frames == 0)
+        return stats;
+
+    // The frames are the parallel work, each renderer draws with one thread
+    int renderer_count = std::min(render_threads, stats.frames);
+    std::vector<std::unique_ptr<Renderer>> renderers;
+    for (int i = 0; i < renderer_count; i++)
+    {
+        renderers.push_back(std::make_unique<Renderer>(source.image().size()));
+        renderers.back()->setThreadCount(1);
+        renderers.back()->shareMeshes(source);
+    }
+
+    queue.clear();
+    queue_capacity = 2 * renderer_count;
+    rendering_done = false;
+    std::vector<std::thread> savers;
+    for (int i = 0; i < save_threads; i++)
+        savers.emplace_back(&BatchRenderer::saveLoop, this, std::cref(pattern), std::ref(stats));
+
+    std::atomic<int> next_frame(0);
+    WorkerPool pool(renderer_count);
+    pool.run(renderer_count, [&](size_t job) {
+        Renderer &renderer = *renderers[job];
+        Renderer::SceneState frame_scene = scene;
+        double render_seconds = 0, stall_seconds = 0;
+        for (int frame; (frame = next_frame++) < stats.frames;)
+        {
+            Clock::time_point render_start = Clock::now();
+            path.apply(frame, frame_scene);
+            renderer.render(frame_scene);
+            render_seconds += secondsSince(render_start);
+
+            Clock::time_point wait_start = Clock::now();
+            std::unique_lock<std::mutex> lock(mutex);
+            queue_changed.wait(lock, [this] { return queue.size() < queue_capacity; });
+            stall_seconds += secondsSince(wait_start);
+            // Shared with the renderer until it clears the image for its next frame
+            queue.push_back({frame, renderer.image()});
+            queue_changed.notify_all();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.render_seconds += render_seconds;
+        stats.stall_seconds += stall_seconds;
+    });
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        rendering_done = true;
+    }
+    queue_changed.notify_all();
+    for (std::thread &saver : savers)
+        saver.join();
+
+    stats.seconds = secondsSince(start);
+    return stats;
+}
+
+void BatchRenderer::saveLoop(const QString &pattern, BatchStats &stats)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        queue_changed.wait(lock, [this] { return !queue.empty() || rendering_done; });
+        if (queue.empty())
+            return;
+
+        Frame frame = std::move(queue.front());
+        queue.pop_front();
+        queue_changed.notify_all();
+        lock.unlock();
+
+        Clock::time_point save_start = Clock::now();
+        bool saved = frame.image.save(frameName(pattern, frame.number));
+        double seconds = secondsSince(save_start);
+        frame.image = QImage();
+
+        lock.lock();
+        stats.save_seconds += seconds;
+        stats.failed += saved ? 0 : 1;
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QImage>
+#include <QString>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include "CameraPath.h"
+#include "Renderer.h"
+
+// Counters of one batch. Stage times are summed over the threads running the
+// stage, so they may exceed the wall time.
+struct BatchStats
+{
+    int frames = 0;
+    int failed = 0;             // frames that could not be written
+    double seconds = 0;         // wall time of the whole batch
+    double render_seconds = 0;  // drawing the frames
+    double save_seconds = 0;    // encoding and writing them
+    double stall_seconds = 0;   // renderers waiting for room in the save queue
+};
+
+// Renders every frame of a camera path into numbered image files.
+//
+// The frames are independent, so several renderers draw different frames at
+// once, one per thread, all sharing the meshes of the renderer the terrain
+// was loaded into. Finished frames wait in a short queue for saving threads,
+// which encode and write them while the next frames render; a full queue
+// holds the renderers back, so memory stays bounded when saving is slower.
+class BatchRenderer
+{
+public:
+    // 0 render threads means one per hardware thread
+    BatchRenderer(int render_threads = 0, int save_threads = 2);
+
+    // The frames of path seen with scene, drawn at the image size of source.
+    // The frame number replaces the run of '#' in pattern, zero-padded to its
+    // length, e.g. "frames/####.png".
+    BatchStats render(const Renderer &source, const Renderer::SceneState &scene, const CameraPath &path,
+                      const QString &pattern);
+
+    static QString frameName(const QString &pattern, int frame);
+
+    int renderThreads() const { return render_threads; }
+    int saveThreads() const { return save_threads; }
+
+private:
+    struct Frame
+    {
+        int number;
+        QImage image;
+    };
+
+    void saveLoop(const QString &pattern, BatchStats &stats);
+
+    int render_threads, save_threads;
+
+    std::mutex mutex;
+    std::condition_variable queue_changed;
+    std::deque<Frame> queue; // rendered, not saved yet
+    size_t queue_capacity = 0;
+    bool rendering_done = false;
+};
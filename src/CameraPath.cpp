@@ -0,0 +1,101 @@
+#include "CameraPath.h"
+
+#include <QFile>
+#include <algorithm>
+
+bool CameraPath::load(const QString &filename)
+{
+    keys.clear();
+    light = false;
+    error.clear();
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        error = file.errorString();
+        return false;
+    }
+
+    for (int line = 1; !file.atEnd(); line++)
+    {
+        QString text = QString::fromUtf8(file.readLine()).simplified();
+        if (text.isEmpty() || text.startsWith('#'))
+            continue;
+
+        QStringList fields = text.split(' ');
+        if (fields.size() != 6 && fields.size() != 9)
+        {
+            error = QString("Line %1: expected 6 or 9 values, found %2").arg(line).arg(fields.size());
+            return false;
+        }
+        bool with_light = fields.size() == 9;
+        if (!keys.empty() && with_light != light)
+        {
+            error = QString("Line %1: the light must be given on every line or on none").arg(line);
+            return false;
+        }
+
+        bool ok = true;
+        double values[9];
+        for (int i = 0; i < fields.size() && ok; i++)
+            values[i] = fields[i].toDouble(&ok);
+        CameraKey key;
+        key.frame = (int)values[0];
+        if (!ok || key.frame != values[0] || key.frame < 0)
+        {
+            error = QString("Line %1: invalid keyframe").arg(line);
+            return false;
+        }
+        if (!keys.empty() && key.frame <= keys.back().frame)
+        {
+            error = QString("Line %1: frame %2 does not follow frame %3").arg(line).arg(key.frame).arg(keys.back().frame);
+            return false;
+        }
+        key.position = QVector3D(values[1], values[2], values[3]);
+        key.zenith = values[4];
+        key.azimuth = values[5];
+        if (with_light)
+            key.light = QVector3D(values[6], values[7], values[8]);
+
+        light = with_light;
+        keys.push_back(key);
+    }
+
+    if (keys.empty())
+    {
+        error = "File holds no keyframes";
+        return false;
+    }
+    return true;
+}
+
+CameraKey CameraPath::at(int frame) const
+{
+    // Last keyframe at or before frame
+    auto next = std::upper_bound(keys.begin(), keys.end(), frame,
+                                 [](int value, const CameraKey &key) { return value < key.frame; });
+    if (next == keys.begin())
+        return keys.front();
+    if (next == keys.end())
+        return keys.back();
+
+    const CameraKey &a = *(next - 1), &b = *next;
+    float t = float(frame - a.frame) / (b.frame - a.frame);
+    CameraKey key;
+    key.frame = frame;
+    key.position = a.position + t * (b.position - a.position);
+    key.zenith = a.zenith + t * (b.zenith - a.zenith);
+    key.azimuth = a.azimuth + t * (b.azimuth - a.azimuth);
+    key.light = a.light + t * (b.light - a.light);
+    return key;
+}
+
+void CameraPath::apply(int frame, Renderer::SceneState &scene) const
+{
+    CameraKey key = at(frame);
+    scene.camera.position = key.position * scene.object_scale;
+    scene.camera.zenit = qDegreesToRadians(key.zenith);
+    scene.camera.azimuth = qDegreesToRadians(key.azimuth);
+    if (light)
+        scene.lightSource.position = key.light;
+}
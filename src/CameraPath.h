@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QString>
+#include <QVector3D>
+#include <vector>
+#include "Renderer.h"
+
+struct CameraKey
+{
+    int frame;
+    QVector3D position;
+    double zenith, azimuth; // in degrees
+    QVector3D light;        // position of the light, if the path has one
+};
+
+// Camera flight read from a text file of keyframes, one per line:
+//
+//   frame  x y z  zenith azimuth  [light_x light_y light_z]
+//
+// Frames must increase from line to line; frames between two keyframes are
+// interpolated linearly, angles included, so an azimuth going from 0 to 720
+// circles twice. The light is given on every line or on none. Empty lines
+// and lines starting with '#' are skipped.
+class CameraPath
+{
+public:
+    bool load(const QString &filename);
+    QString errorString() const { return error; } // why load() failed
+
+    bool isEmpty() const { return keys.empty(); }
+    int frameCount() const { return keys.empty() ? 0 : keys.back().frame + 1; }
+    bool hasLight() const { return light; }
+
+    CameraKey at(int frame) const; // interpolated, frames outside the path keep its ends
+    // Camera, and light if the path has one, of frame. Positions are scaled
+    // by the zoom (object_scale) of scene, as zooming in the viewer does.
+    void apply(int frame, Renderer::SceneState &scene) const;
+
+private:
+    std::vector<CameraKey> keys;
+    bool light = false;
+    QString error;
+};
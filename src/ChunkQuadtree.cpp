@@ -0,0 +1,212 @@
+#include "ChunkQuadtree.h"
+
+#include <algorithm>
+#include <cmath>
+
+void ChunkQuadtree::build(const HeightfieldMesh &mesh, int cells)
+{
+    clear();
+    chunk_cells = std::max(1, cells);
+    levels = 1;
+    while ((1 << levels) <= chunk_cells)
+        levels++;
+    if (mesh.cellCount() == 0)
+        return;
+
+    chunks_x = (mesh.cols - 1 + chunk_cells - 1) / chunk_cells;
+    chunks_y = (mesh.rows - 1 + chunk_cells - 1) / chunk_cells;
+    leaves.assign((size_t)chunks_x * chunks_y, -1);
+    errors.assign(leaves.size() * levels, 0);
+    max_levels.assign(leaves.size(), 0);
+    build(mesh, 0, mesh.rows - 1, 0, mesh.cols - 1);
+}
+void ChunkQuadtree::clear()
+{
+    nodes.clear();
+    leaves.clear();
+    errors.clear();
+    max_levels.clear();
+    chunks_x = chunks_y = 0;
+}
+
+int ChunkQuadtree::build(const HeightfieldMesh &mesh, int first_row, int last_row, int first_col, int last_col)
+{
+    int index = (int)nodes.size();
+    nodes.push_back({QVector3D(), QVector3D(), first_row, last_row, first_col, last_col, 1, {-1, -1, -1, -1}});
+
+    // Split at a chunk boundary near the middle, halves of a single chunk stay whole
+    int row_chunks = (last_row - first_row + chunk_cells - 1) / chunk_cells;
+    int col_chunks = (last_col - first_col + chunk_cells - 1) / chunk_cells;
+    if (row_chunks == 1 && col_chunks == 1)
+    {
+        float min_x = mesh.x[mesh.index(first_row, first_col)], max_x = min_x;
+        float min_y = mesh.y[mesh.index(first_row, first_col)], max_y = min_y;
+        float min_z = mesh.z[mesh.index(first_row, first_col)], max_z = min_z;
+        for (int row = first_row; row <= last_row; row++)
+        {
+            for (unsigned i = mesh.index(row, first_col); i <= mesh.index(row, last_col); i++)
+            {
+                min_x = std::min(min_x, mesh.x[i]);
+                max_x = std::max(max_x, mesh.x[i]);
+                min_y = std::min(min_y, mesh.y[i]);
+                max_y = std::max(max_y, mesh.y[i]);
+                min_z = std::min(min_z, mesh.z[i]);
+                max_z = std::max(max_z, mesh.z[i]);
+            }
+        }
+        nodes[index].min = QVector3D(min_x, min_y, min_z);
+        nodes[index].max = QVector3D(max_x, max_y, max_z);
+
+        int id = first_row / chunk_cells * chunks_x + first_col / chunk_cells;
+        leaves[id] = index;
+        measureLevels(mesh, nodes[index], id);
+        return index;
+    }
+
+    int mid_row = first_row + (row_chunks + 1) / 2 * chunk_cells;
+    int mid_col = first_col + (col_chunks + 1) / 2 * chunk_cells;
+    int rows[3] = {first_row, std::min(mid_row, last_row), last_row};
+    int cols[3] = {first_col, std::min(mid_col, last_col), last_col};
+
+    int child = 0;
+    for (int r = 0; r < 2; r++)
+    {
+        for (int c = 0; c < 2; c++)
+        {
+            if (rows[r] == rows[r + 1] || cols[c] == cols[c + 1])
+                continue;
+            int child_index = build(mesh, rows[r], rows[r + 1], cols[c], cols[c + 1]);
+            Node &node = nodes[index]; // build() may have reallocated
+            const Node &child_node = nodes[child_index];
+            node.chunks = child == 0 ? child_node.chunks : node.chunks + child_node.chunks;
+            if (child == 0)
+            {
+                node.min = child_node.min;
+                node.max = child_node.max;
+            }
+            else
+            {
+                node.min = QVector3D(std::min(node.min.x(), child_node.min.x()), std::min(node.min.y(), child_node.min.y()),
+                                     std::min(node.min.z(), child_node.min.z()));
+                node.max = QVector3D(std::max(node.max.x(), child_node.max.x()), std::max(node.max.y(), child_node.max.y()),
+                                     std::max(node.max.z(), child_node.max.z()));
+            }
+            node.children[child++] = child_index;
+        }
+    }
+    return index;
+}
+
+size_t ChunkQuadtree::cull(const QMatrix4x4 &transform, float left, float top, float right, float bottom,
+                           std::vector<TerrainChunk> &visible) const
+{
+    if (nodes.empty())
+        return 0;
+
+    // The screen rectangle in front of the viewer as planes in homogeneous screen
+    // coordinates (x, y, w), a point is inside when a * x + b * y + c * w >= 0.
+    // The rectangle gets a pixel of margin for the rasterizer's rounding.
+    const float planes[5][3] = {{0, 0, 1},
+                                {1, 0, -(left - 1)},
+                                {-1, 0, right + 1},
+                                {0, 1, -(top - 1)},
+                                {0, -1, bottom + 1}};
+    const float *m = transform.constData();
+
+    // Depth first, children are pushed in reverse so they are visited in order
+    struct Entry
+    {
+        int node;
+        bool inside; // the whole box is known to be inside
+    } stack[4 * 32]; // at most 3 entries per level
+    int size = 0;
+    stack[size++] = {0, false};
+
+    size_t rejected = 0;
+    while (size > 0)
+    {
+        Entry entry = stack[--size];
+        const Node &node = nodes[entry.node];
+
+        if (!entry.inside)
+        {
+            int outside[5] = {0, 0, 0, 0, 0}, inside = 0;
+            for (int corner = 0; corner < 8; corner++)
+            {
+                float x = corner & 1 ? node.max.x() : node.min.x();
+                float y = corner & 2 ? node.max.y() : node.min.y();
+                float z = corner & 4 ? node.max.z() : node.min.z();
+                float sx = m[0] * x + m[4] * y + m[8] * z + m[12];
+                float sy = m[1] * x + m[5] * y + m[9] * z + m[13];
+                float w = m[3] * x + m[7] * y + m[11] * z + m[15];
+
+                bool corner_inside = true;
+                for (int p = 0; p < 5; p++)
+                {
+                    if (planes[p][0] * sx + planes[p][1] * sy + planes[p][2] * w < 0)
+                    {
+                        outside[p]++;
+                        corner_inside = false;
+                    }
+                }
+                inside += corner_inside;
+            }
+
+            // All corners behind one plane, the box cannot reach the rectangle
+            if (std::find(std::begin(outside), std::end(outside), 8) != std::end(outside))
+            {
+                rejected += node.chunks;
+                continue;
+            }
+            entry.inside = inside == 8;
+        }
+
+        if (node.children[0] < 0)
+        {
+            TerrainChunk chunk;
+            chunk.first_row = node.first_row;
+            chunk.last_row = node.last_row;
+            chunk.first_col = node.first_col;
+            chunk.last_col = node.last_col;
+            chunk.id = node.first_row / chunk_cells * chunks_x + node.first_col / chunk_cells;
+            visible.push_back(chunk);
+            continue;
+        }
+        for (int child = 3; child >= 0; child--)
+            if (node.children[child] >= 0)
+                stack[size++] = {node.children[child], entry.inside};
+    }
+    return rejected;
+}
+
+void ChunkQuadtree::measureLevels(const HeightfieldMesh &mesh, const Node &leaf, int id)
+{
+    float *level_errors = &errors[(size_t)id * levels];
+    for (int level = 1; level < levels; level++)
+    {
+        // Both spans have to be multiples of the step, partial chunks at the border stop early
+        int step = 1 << level;
+        if ((leaf.last_row - leaf.first_row) % step != 0 || (leaf.last_col - leaf.first_col) % step != 0)
+            break;
+
+        // Height of the coarse cell triangles (split like HeightfieldMesh::triangle()) at every vertex
+        float error = level_errors[level - 1];
+        for (int row = leaf.first_row; row <= leaf.last_row; row++)
+        {
+            int r0 = std::min(leaf.first_row + (row - leaf.first_row) / step * step, leaf.last_row - step);
+            float v = (float)(row - r0) / step;
+            for (int col = leaf.first_col; col <= leaf.last_col; col++)
+            {
+                int c0 = std::min(leaf.first_col + (col - leaf.first_col) / step * step, leaf.last_col - step);
+                float u = (float)(col - c0) / step;
+                float z00 = mesh.z[mesh.index(r0, c0)], z01 = mesh.z[mesh.index(r0, c0 + step)];
+                float z10 = mesh.z[mesh.index(r0 + step, c0)], z11 = mesh.z[mesh.index(r0 + step, c0 + step)];
+                float z = u >= v ? z00 + u * (z01 - z00) + v * (z11 - z01)
+                                 : z00 + v * (z10 - z00) + u * (z11 - z10);
+                error = std::max(error, std::fabs(mesh.z[mesh.index(row, col)] - z));
+            }
+        }
+        level_errors[level] = error;
+        max_levels[id] = level;
+    }
+}
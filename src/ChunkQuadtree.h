@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <vector>
+#include "HeightfieldMesh.h"
+
+// Square block of heightfield cells with its screen bounds in the current frame.
+// It spans the vertex rows first_row .. last_row and columns first_col .. last_col.
+struct TerrainChunk
+{
+    int first_row, last_row;
+    int first_col, last_col;
+    int id;        // row-major position among the chunks
+    int level = 0; // mip level, only every 2^level-th row and column is used
+    float min_x = 0, min_y = 0, max_x = 0, max_y = 0;
+    float max_z = 0;                          // closest depth
+    size_t first_face = 0, face_count = 0; // triangles in RenderBuffers::faces
+
+    size_t triangleCount() const { return 2 * (size_t)(last_row - first_row) * (last_col - first_col); }
+    int step() const { return 1 << level; }
+};
+
+// Bounding box quadtree over the chunks of a HeightfieldMesh.
+//
+// The grid is cut into chunks of chunk_cells x chunk_cells cells, which are the
+// leaves. Every node keeps the bounding box of its vertices in mesh coordinates,
+// so whole quadrants can be rejected against the view frustum with 8 corner
+// tests. The tree depends only on the mesh geometry and has to be rebuilt when
+// it changes; zoom, z scale and camera go into the matrix passed to cull().
+//
+// For level of detail every chunk also keeps the vertical error of its mip
+// levels: level l keeps every 2^l-th row and column, and its error is the
+// largest height difference between a skipped vertex and the coarser surface.
+// chunk_cells has to be a power of two.
+class ChunkQuadtree
+{
+public:
+    void build(const HeightfieldMesh &mesh, int chunk_cells);
+    void clear();
+
+    size_t chunkCount() const { return leaves.size(); }
+    int chunksPerRow() const { return chunks_x; }
+    int chunksPerColumn() const { return chunks_y; }
+    void bounds(int id, QVector3D &min, QVector3D &max) const
+    {
+        min = nodes[leaves[id]].min;
+        max = nodes[leaves[id]].max;
+    }
+
+    // Levels 0 .. maxLevel(), chunks at the grid border may not allow all of them
+    int maxLevel(const TerrainChunk &chunk) const { return max_levels[chunk.id]; }
+    float levelError(int id, int level) const { return errors[(size_t)id * levels + level]; }
+    int levelCount() const { return levels; } // of the largest chunks
+
+    // Appends the chunks that may be visible through the screen rectangle
+    // [left, right) x [top, bottom) after transform (projection included) and
+    // returns the number of chunks rejected
+    size_t cull(const QMatrix4x4 &transform, float left, float top, float right, float bottom,
+                std::vector<TerrainChunk> &visible) const;
+
+private:
+    struct Node
+    {
+        QVector3D min, max;
+        int first_row, last_row;
+        int first_col, last_col;
+        size_t chunks;   // leaves in the subtree
+        int children[4]; // -1 for none, all -1 in leaves
+    };
+
+    int build(const HeightfieldMesh &mesh, int first_row, int last_row, int first_col, int last_col);
+    void measureLevels(const HeightfieldMesh &mesh, const Node &leaf, int id);
+
+    int chunk_cells = 1;
+    int levels = 1;
+    int chunks_x = 0, chunks_y = 0;
+    std::vector<Node> nodes;         // root first
+    std::vector<int> leaves;         // node of every chunk id
+    std::vector<float> errors;       // levels per chunk
+    std::vector<uint8_t> max_levels; // per chunk
+};
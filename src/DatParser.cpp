@@ -0,0 +1,198 @@
+#include "DatParser.h"
+
+#include <QFile>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <locale.h>
+#if !defined(__cpp_lib_to_chars) && defined(__APPLE__)
+#include <xlocale.h>
+#endif
+
+// Chunks are at least this large so tiny files are not split at all
+static const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+#if !defined(__cpp_lib_to_chars)
+// strtod of a terminated copy of the number, independent of the locale Qt set
+static std::from_chars_result parseNumberFallback(const char *first, const char *last, double &value)
+{
+    char number[64];
+    size_t length = 0;
+    while (first + length < last && length < sizeof(number) - 1 &&
+           (std::isalnum((unsigned char)first[length]) || first[length] == '.' || first[length] == '-' || first[length] == '+'))
+        length++;
+    if (length == 0 || *first == '+')
+        return {first, std::errc::invalid_argument};
+    std::memcpy(number, first, length);
+    number[length] = 0;
+
+    char *end;
+    errno = 0;
+#if defined(_WIN32)
+    static _locale_t c_locale = _create_locale(LC_NUMERIC, "C");
+    double result = _strtod_l(number, &end, c_locale);
+#else
+    static locale_t c_locale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+    double result = strtod_l(number, &end, c_locale);
+#endif
+    if (end == number)
+        return {first, std::errc::invalid_argument};
+    if (errno == ERANGE)
+        return {first + (end - number), std::errc::result_out_of_range};
+    value = result;
+    return {first + (end - number), std::errc()};
+}
+#endif
+
+std::from_chars_result parseNumber(const char *first, const char *last, double &value)
+{
+#if defined(__cpp_lib_to_chars)
+    return std::from_chars(first, last, value);
+#else
+    return parseNumberFallback(first, last, value);
+#endif
+}
+std::from_chars_result parseNumber(const char *first, const char *last, float &value)
+{
+#if defined(__cpp_lib_to_chars)
+    return std::from_chars(first, last, value);
+#else
+    double result;
+    std::from_chars_result parsed = parseNumberFallback(first, last, result);
+    if (parsed.ec == std::errc() && std::isfinite(result) && std::fabs(result) > FLT_MAX)
+        parsed.ec = std::errc::result_out_of_range;
+    if (parsed.ec == std::errc())
+        value = (float)result;
+    return parsed;
+#endif
+}
+
+bool DatParser::parse(const QString &filename, std::vector<double> &xyz)
+{
+    error.clear();
+    error_line = error_column = 0;
+    xyz.clear();
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        error = file.errorString();
+        return false;
+    }
+    qint64 size = file.size();
+    if (size == 0)
+        return true;
+
+    uchar *data = file.map(0, size);
+    if (data == nullptr)
+    {
+        error = file.errorString();
+        return false;
+    }
+    const char *text = reinterpret_cast<const char *>(data);
+    bool ok = parse(text, text + size, xyz);
+    file.unmap(data);
+    return ok;
+}
+
+bool DatParser::parse(const char *begin, const char *end, std::vector<double> &xyz, size_t first_line)
+{
+    error.clear();
+    error_line = error_column = 0;
+    xyz.clear();
+
+    // Cut at the first newline after every chunk_bytes
+    size_t chunk_bytes = std::max(MIN_CHUNK_BYTES, (size_t)(end - begin) / (8 * pool.threadCount()) + 1);
+    std::vector<Chunk> chunks;
+    for (const char *p = begin; p < end;)
+    {
+        const char *stop = end;
+        if ((size_t)(end - p) > chunk_bytes)
+        {
+            const char *newline = static_cast<const char *>(std::memchr(p + chunk_bytes, '\n', end - p - chunk_bytes));
+            stop = newline != nullptr ? newline + 1 : end;
+        }
+        chunks.push_back({p, stop, 0, 0});
+        p = stop;
+    }
+
+    // Every line is a point, the last one may lack its newline
+    pool.run(chunks.size(), [&](size_t i) {
+        Chunk &chunk = chunks[i];
+        chunk.points = std::count(chunk.begin, chunk.end, '\n') + (chunk.end[-1] != '\n');
+    });
+    size_t points = 0;
+    for (Chunk &chunk : chunks)
+    {
+        chunk.first_point = points;
+        points += chunk.points;
+    }
+
+    xyz.resize(3 * points);
+    pool.run(chunks.size(), [&](size_t i) { parseChunk(chunks[i], xyz.data() + 3 * chunks[i].first_point); });
+
+    for (const Chunk &chunk : chunks)
+    {
+        if (chunk.error == nullptr)
+            continue;
+        error_line = first_line + chunk.first_point + chunk.error_line + 1;
+        error_column = chunk.error_column;
+        error = QString("Line %1, column %2: %3").arg(error_line).arg(error_column).arg(chunk.error);
+        xyz.clear();
+        return false;
+    }
+    return true;
+}
+
+void DatParser::parseChunk(Chunk &chunk, double *xyz)
+{
+    size_t line = 0;
+    for (const char *p = chunk.begin; p < chunk.end; line++)
+    {
+        const char *line_begin = p;
+        const char *line_end = static_cast<const char *>(std::memchr(p, '\n', chunk.end - p));
+        p = line_end != nullptr ? line_end + 1 : chunk.end;
+        if (line_end == nullptr)
+            line_end = chunk.end;
+        if (line_end > line_begin && line_end[-1] == '\r')
+            line_end--;
+
+        int fields = 0;
+        const char *field = line_begin;
+        while (true)
+        {
+            while (field < line_end && (*field == ' ' || *field == '\t'))
+                field++;
+            if (field == line_end)
+                break;
+
+            // parseNumber() takes no plus sign
+            const char *number = *field == '+' ? field + 1 : field;
+            double value;
+            std::from_chars_result result = parseNumber(number, line_end, value);
+            if (result.ec != std::errc() || (result.ptr < line_end && *result.ptr != ' ' && *result.ptr != '\t'))
+            {
+                chunk.error = "invalid number";
+                chunk.error_line = line;
+                chunk.error_column = field - line_begin + 1;
+                return;
+            }
+            if (fields < 3)
+                xyz[3 * line + fields] = value;
+            fields++;
+            field = result.ptr;
+        }
+
+        if (fields < 3)
+        {
+            chunk.error = "expected x, y and z";
+            chunk.error_line = line;
+            chunk.error_column = line_end - line_begin + 1;
+            return;
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QString>
+#include <charconv>
+#include <vector>
+#include "WorkerPool.h"
+
+// std::from_chars for floating point, or strtod in the "C" locale where the
+// standard library does not provide it (no __cpp_lib_to_chars, as in the libc++
+// of older Xcode releases and GCC before 11). Like from_chars, it takes neither
+// leading spaces nor a plus sign.
+std::from_chars_result parseNumber(const char *first, const char *last, double &value);
+std::from_chars_result parseNumber(const char *first, const char *last, float &value);
+
+// Parser for text point files with one "x y z" line per point.
+//
+// The text is cut into chunks that end at a newline. A first parallel pass
+// counts the lines of every chunk, which gives each chunk the index of its
+// first point; a second one parses the chunks with parseNumber() straight
+// into one contiguous x, y, z array, without allocating anything per line.
+// Fields are separated by spaces or tabs, lines may end in "\r\n" and further
+// numbers after the third are ignored. Parsing stops at the first malformed
+// line in file order, whose position is then given by errorLine() and
+// errorColumn().
+class DatParser
+{
+public:
+    // 0 threads means one per hardware thread
+    explicit DatParser(int threads = 0) : pool(threads) {}
+
+    // Memory maps the file
+    bool parse(const QString &filename, std::vector<double> &xyz);
+    // Error lines count from first_line, for text that starts within a file
+    bool parse(const char *begin, const char *end, std::vector<double> &xyz, size_t first_line = 0);
+
+    // 1-based position of the first error, 0 when there is none or the file
+    // could not be read
+    size_t errorLine() const { return error_line; }
+    size_t errorColumn() const { return error_column; }
+    QString errorString() const { return error; }
+
+private:
+    struct Chunk
+    {
+        const char *begin, *end;
+        size_t first_point, points;
+        size_t error_line = 0, error_column = 0; // line within the chunk, 0-based
+        const char *error = nullptr;
+    };
+
+    static void parseChunk(Chunk &chunk, double *xyz);
+
+    WorkerPool pool;
+    size_t error_line = 0, error_column = 0;
+    QString error;
+};
@@ -0,0 +1,647 @@
+#include "DemFile.h"
+#include "DatParser.h"
+
+#include <QSaveFile>
+#include <QDateTime>
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const char DEM_MAGIC[8] = {'D', 'E', 'M', 'C', 'A', 'C', 'H', 'E'};
+static_assert(sizeof(DemHeader) == 80, "DemHeader is written as is");
+
+// Text parsed at once while converting a large file into the cache
+static const size_t CONVERT_BLOCK_BYTES = (size_t)64 << 20;
+
+// End of the block of lines starting at p
+static const char *blockEnd(const char *p, const char *end)
+{
+    if ((size_t)(end - p) <= CONVERT_BLOCK_BYTES)
+        return end;
+    const char *newline = static_cast<const char *>(std::memchr(p + CONVERT_BLOCK_BYTES, '\n', end - p - CONVERT_BLOCK_BYTES));
+    return newline != nullptr ? newline + 1 : end;
+}
+
+// Lattice of points listed along axis first (0 = x, 1 = y): the first line is
+// the run of points sharing the first coordinate of the other axis, and every
+// point lies within a small fraction of the spacing from its lattice position.
+// Heights are stored row-major with both spacings positive, so the triangles
+// face up whatever the direction of the input.
+struct DemLattice
+{
+    int first, second;
+    size_t inner, outer, rows, cols;
+    double origin[2], spacing[2];
+    double tolerance;
+    bool flip_x, flip_y;
+
+    // Lines of count points, from the first available of them; false if they
+    // do not split into lines along axis
+    bool fitLines(const double *points, size_t available, size_t count, int axis)
+    {
+        first = axis;
+        second = 1 - axis;
+        inner = 1;
+        while (inner < available && points[3 * inner + second] == points[second])
+            inner++;
+        if (inner == available && available < count)
+            return false; // the first line goes on past the points at hand
+        if (count % inner != 0)
+            return false;
+        outer = count / inner;
+        if (first == 1 && inner == 1)
+            return false; // a single row, already tried row-major
+
+        origin[first] = points[first];
+        origin[second] = points[second];
+        spacing[first] = inner > 1 ? (points[3 * (inner - 1) + first] - origin[first]) / (inner - 1) : 0;
+        rows = first == 0 ? outer : inner;
+        cols = first == 0 ? inner : outer;
+        return true;
+    }
+    // Spacing of the lines, from the first point of the last one
+    void fitSpacing(const double *last_line)
+    {
+        spacing[second] = outer > 1 ? (last_line[second] - origin[second]) / (outer - 1) : 0;
+        tolerance = 1e-4 * std::max(std::fabs(spacing[0]), std::fabs(spacing[1]));
+        flip_x = spacing[0] < 0;
+        flip_y = spacing[1] < 0;
+    }
+
+    // Row-major index of the i-th point, false if it is off its position
+    bool cell(size_t i, const double *point, size_t &index) const
+    {
+        size_t o = i / inner, k = i % inner;
+        if (std::fabs(point[first] - (origin[first] + k * spacing[first])) > tolerance ||
+            std::fabs(point[second] - (origin[second] + o * spacing[second])) > tolerance)
+            return false;
+        size_t row = first == 0 ? o : k;
+        size_t col = first == 0 ? k : o;
+        if (flip_y)
+            row = rows - 1 - row;
+        if (flip_x)
+            col = cols - 1 - col;
+        index = row * cols + col;
+        return true;
+    }
+
+    void setGeometry(DemHeader &header) const
+    {
+        header.origin_x = flip_x ? origin[0] + (cols - 1) * spacing[0] : origin[0];
+        header.origin_y = flip_y ? origin[1] + (rows - 1) * spacing[1] : origin[1];
+        header.spacing_x = std::fabs(spacing[0]);
+        header.spacing_y = std::fabs(spacing[1]);
+    }
+};
+
+bool DemFile::open(const QString &filename)
+{
+    close();
+    QFileInfo source(filename);
+    if (!source.exists())
+    {
+        error = "File does not exist";
+        return false;
+    }
+
+    QString suffix = source.suffix().toLower();
+    if (suffix == "hgt")
+        return openSrtm(filename, source);
+
+    QString cache_name = cachePath(filename);
+    if (openCache(cache_name, source))
+        return true;
+
+    // Large files are converted into the cache, unless a .dat is not listed in
+    // lattice order or the cache cannot be written; errorString() is then empty
+    // and they are parsed in memory like the others
+    if (source.size() > LARGE_TEXT_BYTES)
+    {
+        if (suffix == "asc" ? parseAsc(filename, cache_name) : convertDat(filename, cache_name))
+            return commitCache(cache_name, source);
+        if (!error.isEmpty())
+            return false;
+    }
+
+    if (!(suffix == "asc" ? parseAsc(filename) : parseDat(filename)))
+        return false;
+    header.source_size = source.size();
+    header.source_mtime = source.lastModified().toMSecsSinceEpoch();
+    writeCache(cache_name); // best effort, the directory may be read-only
+    return true;
+}
+void DemFile::close()
+{
+    if (mapped != nullptr)
+        file.unmap(mapped);
+    if (file.isOpen())
+        file.close();
+    mapped = nullptr;
+    srtm = false;
+    heights = nullptr;
+    header = DemHeader();
+    owned_heights.clear();
+    error.clear();
+}
+
+HeightGrid DemFile::grid() const
+{
+    HeightGrid grid;
+    grid.rows = header.rows;
+    grid.cols = header.cols;
+    grid.origin_x = header.origin_x;
+    grid.origin_y = header.origin_y;
+    grid.spacing_x = header.spacing_x;
+    grid.spacing_y = header.spacing_y;
+    if (srtm)
+    {
+        // The last row of the tile is the southernmost
+        grid.samples = mapped + (size_t)(header.rows - 1) * header.cols * sizeof(int16_t);
+        grid.row_step = -header.cols;
+        grid.format = HeightGrid::INT16_BIG_ENDIAN;
+        grid.has_nodata = true;
+        grid.nodata = SRTM_NODATA;
+        grid.nodata_height = header.min_z;
+    }
+    else
+    {
+        grid.samples = heights;
+        grid.row_step = header.cols;
+    }
+    return grid;
+}
+
+bool DemFile::openSrtm(const QString &filename, const QFileInfo &source)
+{
+    file.setFileName(filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        error = file.errorString();
+        return false;
+    }
+
+    qint64 size = file.size();
+    int side = (int)std::lround(std::sqrt(size / 2.0));
+    if (side < 2 || (qint64)side * side * 2 != size)
+    {
+        error = "Not an SRTM tile of N x N 16-bit heights";
+        file.close();
+        return false;
+    }
+    mapped = file.map(0, size);
+    if (mapped == nullptr)
+    {
+        error = file.errorString();
+        file.close();
+        return false;
+    }
+
+    int min_z = INT_MAX, max_z = INT_MIN;
+    for (qint64 i = 0; i < size; i += 2)
+    {
+        int value = (int16_t)(mapped[i] << 8 | mapped[i + 1]);
+        if (value == SRTM_NODATA)
+            continue;
+        min_z = std::min(min_z, value);
+        max_z = std::max(max_z, value);
+    }
+    if (min_z > max_z)
+    {
+        error = "SRTM tile holds no heights";
+        close();
+        return false;
+    }
+
+    // Named after the south west corner, e.g. N45E006; other names start at 0, 0
+    QByteArray name = source.completeBaseName().toUpper().toLatin1();
+    char north_south = 0, east_west = 0;
+    int latitude = 0, longitude = 0;
+    if (std::sscanf(name.constData(), "%c%2d%c%3d", &north_south, &latitude, &east_west, &longitude) == 4 &&
+        (north_south == 'N' || north_south == 'S') && (east_west == 'E' || east_west == 'W'))
+    {
+        header.origin_y = north_south == 'S' ? -latitude : latitude;
+        header.origin_x = east_west == 'W' ? -longitude : longitude;
+    }
+    header.spacing_x = header.spacing_y = 1.0 / (side - 1);
+    setHeader(side, side, min_z, max_z);
+    header.source_size = size;
+    header.source_mtime = source.lastModified().toMSecsSinceEpoch();
+    srtm = true;
+    return true;
+}
+
+bool DemFile::openCache(const QString &filename, const QFileInfo &source)
+{
+    file.setFileName(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    qint64 size = file.size();
+    uchar *data = size >= (qint64)sizeof(DemHeader) ? file.map(0, size) : nullptr;
+    if (data == nullptr)
+    {
+        file.close();
+        return false;
+    }
+
+    DemHeader stored;
+    std::memcpy(&stored, data, sizeof(DemHeader));
+    bool valid = std::memcmp(stored.magic, DEM_MAGIC, sizeof(DEM_MAGIC)) == 0 && stored.version == VERSION &&
+                 stored.rows > 0 && stored.cols > 0 &&
+                 size == (qint64)sizeof(DemHeader) + (qint64)stored.rows * stored.cols * (qint64)sizeof(float);
+    bool fresh = stored.source_size == source.size() &&
+                 stored.source_mtime == source.lastModified().toMSecsSinceEpoch();
+    if (!valid || !fresh)
+    {
+        file.unmap(data);
+        file.close();
+        return false;
+    }
+
+    header = stored;
+    mapped = data;
+    heights = reinterpret_cast<const float *>(data + sizeof(DemHeader));
+    return true;
+}
+
+bool DemFile::writeCache(const QString &filename) const
+{
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    qint64 bytes = (qint64)owned_heights.size() * sizeof(float);
+    if (file.write(reinterpret_cast<const char *>(&header), sizeof(DemHeader)) != (qint64)sizeof(DemHeader) ||
+        file.write(reinterpret_cast<const char *>(owned_heights.data()), bytes) != bytes)
+    {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+// A new cache of rows x cols heights, mapped writable into file and filled in
+// place. It is written next to the cache and only replaces it in commitCache().
+float *DemFile::createCache(const QString &filename, int rows, int cols)
+{
+    qint64 size = (qint64)sizeof(DemHeader) + (qint64)rows * cols * (qint64)sizeof(float);
+    file.setFileName(filename + ".part");
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate) || !file.resize(size) ||
+        (mapped = file.map(0, size)) == nullptr)
+    {
+        discardCache();
+        return nullptr;
+    }
+    return reinterpret_cast<float *>(mapped + sizeof(DemHeader));
+}
+// Stores the header in the cache made by createCache(), puts it in place of
+// the cache and maps that, read-only
+bool DemFile::commitCache(const QString &filename, const QFileInfo &source)
+{
+    header.source_size = source.size();
+    header.source_mtime = source.lastModified().toMSecsSinceEpoch();
+    std::memcpy(mapped, &header, sizeof(DemHeader));
+    file.unmap(mapped);
+    mapped = nullptr;
+    bool written = file.flush();
+    file.close();
+
+    QFile::remove(filename);
+    if (!written || !file.rename(filename) || !openCache(filename, source))
+    {
+        error = QString("Could not write %1").arg(filename);
+        discardCache();
+        return false;
+    }
+    return true;
+}
+void DemFile::discardCache()
+{
+    if (mapped != nullptr)
+        file.unmap(mapped);
+    mapped = nullptr;
+    file.close();
+    file.remove();
+}
+
+bool DemFile::parseDat(const QString &filename)
+{
+    std::vector<double> xyz;
+    DatParser parser;
+    if (!parser.parse(filename, xyz))
+    {
+        error = parser.errorString();
+        return false;
+    }
+    if (xyz.empty())
+    {
+        error = "File holds no points";
+        return false;
+    }
+    if (!fitGrid(xyz))
+    {
+        error = "Points do not form a regular grid";
+        return false;
+    }
+    return true;
+}
+
+// Converts a lattice of points listed row by row or column by column into the
+// cache, parsing a block of lines at a time. Fails with errorString() empty
+// for points in any other order and when the cache cannot be created.
+bool DemFile::convertDat(const QString &filename, const QString &cache_name)
+{
+    QFile text(filename);
+    if (!text.open(QIODevice::ReadOnly))
+    {
+        error = text.errorString();
+        return false;
+    }
+    qint64 size = text.size();
+    const char *begin = size > 0 ? reinterpret_cast<const char *>(text.map(0, size)) : nullptr;
+    if (begin == nullptr)
+        return false;
+    const char *end = begin + size;
+
+    // Every line is a point, as in DatParser
+    size_t count = std::count(begin, end, '\n') + (end[-1] != '\n');
+    DatParser parser;
+    std::vector<double> xyz;
+    if (!parser.parse(begin, blockEnd(begin, end), xyz))
+    {
+        error = parser.errorString();
+        return false;
+    }
+
+    DemLattice lattice;
+    std::vector<double> last_line;
+    bool fitted = false;
+    for (int axis = 0; axis < 2 && !fitted; axis++)
+    {
+        if (!lattice.fitLines(xyz.data(), xyz.size() / 3, count, axis))
+            continue;
+
+        // The last line starts inner points before the end
+        const char *line = end - (end[-1] == '\n');
+        for (size_t lines = 0; line > begin; line--)
+            if (line[-1] == '\n' && ++lines == lattice.inner)
+                break;
+        const char *line_end = static_cast<const char *>(std::memchr(line, '\n', end - line));
+        if (!parser.parse(line, line_end != nullptr ? line_end : end, last_line, count - lattice.inner))
+        {
+            error = parser.errorString();
+            return false;
+        }
+        lattice.fitSpacing(last_line.data());
+
+        // The first block decides the axis, as fitGrid() would with all points
+        fitted = true;
+        size_t index;
+        for (size_t i = 0; i < xyz.size() / 3 && fitted; i++)
+            fitted = lattice.cell(i, &xyz[3 * i], index);
+    }
+    if (!fitted)
+        return false;
+
+    float *out = createCache(cache_name, (int)lattice.rows, (int)lattice.cols);
+    if (out == nullptr)
+        return false;
+    float min_z = FLT_MAX, max_z = -FLT_MAX;
+    size_t point = 0;
+    for (const char *p = begin; p < end;)
+    {
+        const char *stop = blockEnd(p, end);
+        if (!parser.parse(p, stop, xyz, point))
+        {
+            error = parser.errorString();
+            discardCache();
+            return false;
+        }
+        for (size_t i = 0; i < xyz.size(); i += 3, point++)
+        {
+            size_t index;
+            if (!lattice.cell(point, &xyz[i], index))
+            {
+                discardCache(); // not a lattice in this order after all
+                return false;
+            }
+            float z = xyz[i + 2];
+            out[index] = z;
+            min_z = std::min(min_z, z);
+            max_z = std::max(max_z, z);
+        }
+        p = stop;
+    }
+
+    setHeader((int)lattice.rows, (int)lattice.cols, min_z, max_z);
+    lattice.setGeometry(header);
+    return true;
+}
+
+// Into the cache named, if any; see open()
+bool DemFile::parseAsc(const QString &filename, const QString &cache_name)
+{
+    QFile text(filename);
+    if (!text.open(QIODevice::ReadOnly))
+    {
+        error = text.errorString();
+        return false;
+    }
+    qint64 size = text.size();
+    const char *p = size > 0 ? reinterpret_cast<const char *>(text.map(0, size)) : nullptr;
+    if (p == nullptr)
+    {
+        error = "File holds no grid";
+        return false;
+    }
+    const char *end = p + size;
+
+    size_t line = 1;
+    auto skipSpace = [&] {
+        for (; p < end && std::isspace((unsigned char)*p); p++)
+            line += *p == '\n';
+    };
+
+    // "key value" lines up to the first line of heights
+    double ncols = 0, nrows = 0, cellsize = 0, dx = 0, dy = 0, nodata = 0;
+    double x = NAN, y = NAN;
+    bool x_center = false, y_center = false, has_nodata = false;
+    for (skipSpace(); p < end && std::isalpha((unsigned char)*p); skipSpace())
+    {
+        const char *key_end = p;
+        while (key_end < end && !std::isspace((unsigned char)*key_end))
+            key_end++;
+        QByteArray key = QByteArray(p, key_end - p).toLower();
+        for (p = key_end; p < end && (*p == ' ' || *p == '\t'); p++)
+            ;
+
+        double value;
+        std::from_chars_result result = parseNumber(p, end, value);
+        if (result.ec != std::errc())
+        {
+            error = QString("Line %1: invalid value of %2").arg(line).arg(QString::fromLatin1(key));
+            return false;
+        }
+        p = result.ptr;
+
+        if (key == "ncols")
+            ncols = value;
+        else if (key == "nrows")
+            nrows = value;
+        else if (key == "cellsize")
+            cellsize = value;
+        else if (key == "dx")
+            dx = value;
+        else if (key == "dy")
+            dy = value;
+        else if (key == "xllcorner" || key == "xllcenter")
+        {
+            x = value;
+            x_center = key == "xllcenter";
+        }
+        else if (key == "yllcorner" || key == "yllcenter")
+        {
+            y = value;
+            y_center = key == "yllcenter";
+        }
+        else if (key == "nodata_value")
+        {
+            nodata = value;
+            has_nodata = true;
+        }
+    }
+    if (dx == 0)
+        dx = cellsize;
+    if (dy == 0)
+        dy = cellsize;
+    if (ncols < 1 || nrows < 1 || ncols * nrows > INT_MAX || dx <= 0 || dy <= 0 || std::isnan(x) || std::isnan(y))
+    {
+        error = "ESRI grid header needs ncols, nrows, xllcorner, yllcorner and cellsize";
+        return false;
+    }
+
+    int rows = (int)nrows, cols = (int)ncols;
+    size_t count = (size_t)rows * cols;
+    float *out;
+    if (cache_name.isEmpty())
+    {
+        owned_heights.resize(count);
+        out = owned_heights.data();
+    }
+    else if ((out = createCache(cache_name, rows, cols)) == nullptr)
+        return false;
+    auto discard = [&] {
+        if (cache_name.isEmpty())
+            owned_heights.clear();
+        else
+            discardCache();
+    };
+    float missing = (float)nodata;
+    float min_z = FLT_MAX, max_z = -FLT_MAX;
+    for (size_t i = 0; i < count; i++)
+    {
+        skipSpace();
+        float value;
+        std::from_chars_result result = parseNumber(p, end, value);
+        if (result.ec != std::errc())
+        {
+            error = p == end ? QString("Expected %1 heights, found %2").arg(count).arg(i)
+                             : QString("Line %1: invalid height").arg(line);
+            discard();
+            return false;
+        }
+        p = result.ptr;
+
+        // The first line is the northernmost row
+        size_t row = rows - 1 - i / cols;
+        out[row * cols + i % cols] = value;
+        if (has_nodata && value == missing)
+            continue;
+        min_z = std::min(min_z, value);
+        max_z = std::max(max_z, value);
+    }
+    if (min_z > max_z)
+    {
+        error = "ESRI grid holds no heights";
+        discard();
+        return false;
+    }
+    if (has_nodata)
+        std::replace(out, out + count, missing, min_z);
+
+    // Heights lie in the middle of their cells
+    header.origin_x = x_center ? x : x + dx / 2;
+    header.origin_y = y_center ? y : y + dy / 2;
+    header.spacing_x = dx;
+    header.spacing_y = dy;
+    setHeader(rows, cols, min_z, max_z);
+    if (cache_name.isEmpty())
+        heights = owned_heights.data();
+    return true;
+}
+
+void DemFile::setHeader(int rows, int cols, float min_z, float max_z)
+{
+    std::memcpy(header.magic, DEM_MAGIC, sizeof(DEM_MAGIC));
+    header.version = VERSION;
+    header.rows = rows;
+    header.cols = cols;
+    header.min_z = min_z;
+    header.max_z = max_z;
+}
+
+// Fills the header and heights if the points are a regular grid listed row by
+// row or column by column, in any direction, or failing both, in any order.
+bool DemFile::fitGrid(const std::vector<double> &xyz)
+{
+    if (fitLattice(xyz, 0) || fitLattice(xyz, 1))
+        return true;
+
+    // Sorted by y, then x, a grid is row-major
+    size_t count = xyz.size() / 3;
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return xyz[3 * a + 1] != xyz[3 * b + 1] ? xyz[3 * a + 1] < xyz[3 * b + 1] : xyz[3 * a] < xyz[3 * b];
+    });
+    std::vector<double> sorted(xyz.size());
+    for (size_t i = 0; i < count; i++)
+        std::copy(&xyz[3 * order[i]], &xyz[3 * order[i]] + 3, &sorted[3 * i]);
+    return fitLattice(sorted, 0);
+}
+
+// Fits the points as a lattice listed along axis first, see DemLattice
+bool DemFile::fitLattice(const std::vector<double> &xyz, int first)
+{
+    size_t count = xyz.size() / 3;
+    DemLattice lattice;
+    if (!lattice.fitLines(xyz.data(), count, count, first))
+        return false;
+    lattice.fitSpacing(&xyz[3 * (lattice.outer - 1) * lattice.inner]);
+
+    owned_heights.resize(count);
+    float min_z = xyz[2], max_z = xyz[2];
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t index;
+        if (!lattice.cell(i, &xyz[3 * i], index))
+        {
+            owned_heights.clear();
+            return false;
+        }
+        float z = xyz[3 * i + 2];
+        owned_heights[index] = z;
+        min_z = std::min(min_z, z);
+        max_z = std::max(max_z, z);
+    }
+
+    setHeader((int)lattice.rows, (int)lattice.cols, min_z, max_z);
+    lattice.setGeometry(header);
+    heights = owned_heights.data();
+    return true;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <QFile>
+#include <QFileInfo>
+#include <QString>
+#include <cstdint>
+#include <vector>
+#include "HeightfieldMesh.h"
+
+// Header of the binary DEM cache. It is followed by rows * cols float32
+// heights in row-major order, all in the byte order of the machine that wrote
+// it. Vertex (row, col) lies at x = origin_x + col * spacing_x and
+// y = origin_y + row * spacing_y.
+struct DemHeader
+{
+    char magic[8]; // "DEMCACHE"
+    uint32_t version;
+    int32_t rows, cols;
+    float min_z, max_z; // of the heights that are not missing
+    uint32_t reserved;
+    double origin_x, origin_y;
+    double spacing_x, spacing_y;
+    int64_t source_size;  // bytes of the file the cache was made from
+    int64_t source_mtime; // its modification time in ms since the epoch
+};
+
+// Terrain grid read from one of:
+//  - a text .dat file with one "x y z" line per vertex (see DatParser). The
+//    vertices must form a regular grid; its rows, columns, spacing and the
+//    order the vertices are listed in are inferred from the coordinates.
+//  - an ESRI ASCII grid (.asc), a header of "key value" lines followed by
+//    nrows lines of ncols heights from north to south.
+//  - an SRTM tile (.hgt) of N x N big-endian 16-bit heights from north to
+//    south, placed by its name (e.g. N45E006.hgt) in degrees.
+//
+// Text formats are parsed on the first open(), which writes a binary cache
+// next to the file (cachePath()); later opens memory map it instead of
+// parsing. A cache is only used if the file still has the size and
+// modification time it was made from. Text files above LARGE_TEXT_BYTES are
+// converted straight into the cache, a block of lines at a time, and mapped
+// from it, so their grid is never held in memory; the points of such a .dat
+// must be listed row by row or column by column, otherwise it is parsed whole.
+// SRTM tiles are mapped as they are.
+// Missing heights (NODATA_value, -32768 in SRTM) are drawn at the lowest
+// height of the grid.
+class DemFile
+{
+public:
+    static const uint32_t VERSION = 2;
+    static const qint64 LARGE_TEXT_BYTES = (qint64)256 << 20;
+
+    DemFile() {}
+    ~DemFile() { close(); }
+    DemFile(const DemFile &) = delete;
+    DemFile &operator=(const DemFile &) = delete;
+
+    bool open(const QString &filename);
+    void close();
+    QString errorString() const { return error; } // why open() failed
+
+    static QString cachePath(const QString &filename) { return filename + ".cache"; }
+
+    bool isEmpty() const { return header.rows == 0; }
+    bool fromCache() const { return mapped != nullptr && !srtm; }
+    const DemHeader &info() const { return header; }
+    int rows() const { return header.rows; }
+    int cols() const { return header.cols; }
+
+    // Valid while the file stays open
+    HeightGrid grid() const;
+
+private:
+    static const int SRTM_NODATA = -32768;
+
+    bool openSrtm(const QString &filename, const QFileInfo &source);
+    bool openCache(const QString &filename, const QFileInfo &source);
+    bool writeCache(const QString &filename) const;
+    float *createCache(const QString &filename, int rows, int cols);
+    bool commitCache(const QString &filename, const QFileInfo &source);
+    void discardCache();
+    bool parseDat(const QString &filename);
+    bool convertDat(const QString &filename, const QString &cache_name);
+    bool parseAsc(const QString &filename, const QString &cache_name = QString());
+    bool fitGrid(const std::vector<double> &xyz);
+    bool fitLattice(const std::vector<double> &xyz, int first);
+    void setHeader(int rows, int cols, float min_z, float max_z);
+
+    DemHeader header = {};
+    QFile file; // mapped cache or SRTM tile, or the cache being converted into
+    uchar *mapped = nullptr;
+    bool srtm = false;
+    const float *heights = nullptr;   // in mapped or owned_heights, unless srtm
+    std::vector<float> owned_heights; // parsed grid
+    QString error;
+};
@@ -0,0 +1,25 @@
+#include "DepthBuffer.h"
+
+#include <cstring>
+
+void DepthBuffer::resize(int width, int height)
+{
+    w = width;
+    h = height;
+    size_t n = (size_t)w * h;
+
+    // Values of untagged pixels are never read, so only the tags need initializing
+    value.resize(n);
+    tag.assign(n, 0);
+    current = 1;
+}
+
+void DepthBuffer::clear()
+{
+    if (++current != 0)
+        return;
+
+    // Generation counter wrapped, tags from 255 clears ago would look current
+    std::memset(tag.data(), 0, tag.size());
+    current = 1;
+}
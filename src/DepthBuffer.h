@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Depth values of an image for z-buffering, one 32-bit float per pixel.
+//
+// Larger values are closer. In perspective the projection stores 1/w as the
+// depth (see Renderer::projectionMatrix()), which is reversed-Z: distant
+// geometry gets the values near zero, where floats are densest.
+//
+// Clearing is generation based. Every pixel carries an 8-bit tag and only
+// pixels tagged with the current generation hold a depth, all others are
+// empty. clear() starts a new generation without touching the pixels; the
+// tags are reset once every 255 clears.
+class DepthBuffer
+{
+public:
+    static constexpr float EMPTY = -std::numeric_limits<float>::max();
+
+    DepthBuffer() {}
+    DepthBuffer(int width, int height) { resize(width, height); }
+
+    void resize(int width, int height);
+    void clear();
+
+    int width() const { return w; }
+    int height() const { return h; }
+
+    float depth(int x, int y) const
+    {
+        size_t i = (size_t)y * w + x;
+        return tag[i] == current ? value[i] : EMPTY;
+    }
+
+    // Stores z at (x, y) unless the pixel already holds something closer
+    bool test(int x, int y, float z)
+    {
+        size_t i = (size_t)y * w + x;
+        if (tag[i] == current && value[i] > z)
+            return false;
+        value[i] = z;
+        tag[i] = current;
+        return true;
+    }
+
+    // Rows for the rasterizers, a value is set only if its tag equals generation()
+    float *values(int y) { return value.data() + (size_t)y * w; }
+    uint8_t *tags(int y) { return tag.data() + (size_t)y * w; }
+    const float *values(int y) const { return value.data() + (size_t)y * w; }
+    const uint8_t *tags(int y) const { return tag.data() + (size_t)y * w; }
+    uint8_t generation() const { return current; }
+
+private:
+    int w = 0, h = 0;
+    std::vector<float> value;
+    std::vector<uint8_t> tag;
+    uint8_t current = 1;
+};
@@ -0,0 +1,115 @@
+#include "DepthPyramid.h"
+
+#include <algorithm>
+#include <cmath>
+
+void DepthPyramid::resize(int left, int top, int right, int bottom)
+{
+    area_left = left;
+    area_top = top;
+    area_right = std::max(left, right);
+    area_bottom = std::max(top, bottom);
+
+    levels.clear();
+    int width = (area_right - area_left + BLOCK - 1) / BLOCK;
+    int height = (area_bottom - area_top + BLOCK - 1) / BLOCK;
+    while (width > 0 && height > 0)
+    {
+        levels.push_back({width, height, std::vector<float>((size_t)width * height, DepthBuffer::EMPTY)});
+        if (width == 1 && height == 1)
+            break;
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+}
+
+void DepthPyramid::clear()
+{
+    for (Level &level : levels)
+        std::fill(level.depth.begin(), level.depth.end(), DepthBuffer::EMPTY);
+}
+
+void DepthPyramid::update(const DepthBuffer &depth, int left, int top, int right, int bottom)
+{
+    if (levels.empty())
+        return;
+
+    // Blocks touched by the rectangle
+    left = std::max(left, area_left) - area_left;
+    top = std::max(top, area_top) - area_top;
+    right = std::min(right, area_right) - area_left;
+    bottom = std::min(bottom, area_bottom) - area_top;
+    if (left >= right || top >= bottom)
+        return;
+    int first_x = left / BLOCK, last_x = (right - 1) / BLOCK;
+    int first_y = top / BLOCK, last_y = (bottom - 1) / BLOCK;
+
+    Level &base = levels[0];
+    uint8_t generation = depth.generation();
+    for (int block_y = first_y; block_y <= last_y; block_y++)
+    {
+        int y0 = area_top + block_y * BLOCK, y1 = std::min(y0 + BLOCK, area_bottom);
+        for (int block_x = first_x; block_x <= last_x; block_x++)
+        {
+            int x0 = area_left + block_x * BLOCK, x1 = std::min(x0 + BLOCK, area_right);
+            float farthest = std::numeric_limits<float>::max();
+            for (int y = y0; y < y1 && farthest != DepthBuffer::EMPTY; y++)
+            {
+                const float *values = depth.values(y);
+                const uint8_t *tags = depth.tags(y);
+                for (int x = x0; x < x1; x++)
+                    farthest = std::min(farthest, tags[x] == generation ? values[x] : DepthBuffer::EMPTY);
+            }
+            base.depth[(size_t)block_y * base.width + block_x] = farthest;
+        }
+    }
+
+    for (size_t l = 1; l < levels.size(); l++)
+    {
+        const Level &fine = levels[l - 1];
+        Level &coarse = levels[l];
+        first_x /= 2, last_x /= 2, first_y /= 2, last_y /= 2;
+        for (int cell_y = first_y; cell_y <= last_y; cell_y++)
+        {
+            for (int cell_x = first_x; cell_x <= last_x; cell_x++)
+            {
+                float farthest = std::numeric_limits<float>::max();
+                for (int y = 2 * cell_y; y < std::min(2 * cell_y + 2, fine.height); y++)
+                    for (int x = 2 * cell_x; x < std::min(2 * cell_x + 2, fine.width); x++)
+                        farthest = std::min(farthest, fine.depth[(size_t)y * fine.width + x]);
+                coarse.depth[(size_t)cell_y * coarse.width + cell_x] = farthest;
+            }
+        }
+    }
+}
+
+bool DepthPyramid::occluded(float left, float top, float right, float bottom, float max_z) const
+{
+    if (levels.empty())
+        return false;
+
+    // Covered pixels, one pixel of margin for the rasterizer's rounding
+    float x0 = std::max(std::floor(left) - 1, (float)area_left) - area_left;
+    float y0 = std::max(std::floor(top) - 1, (float)area_top) - area_top;
+    float x1 = std::min(std::ceil(right) + 1, (float)area_right) - area_left;
+    float y1 = std::min(std::ceil(bottom) + 1, (float)area_bottom) - area_top;
+    if (!(x0 < x1 && y0 < y1)) // also rejects NaN
+        return false;
+    int first_x = (int)x0 / BLOCK, last_x = ((int)x1 - 1) / BLOCK;
+    int first_y = (int)y0 / BLOCK, last_y = ((int)y1 - 1) / BLOCK;
+
+    // Finest level where the rectangle spans at most 4 x 4 cells
+    size_t l = 0;
+    while (l + 1 < levels.size() && (last_x - first_x >= 4 || last_y - first_y >= 4))
+    {
+        first_x /= 2, last_x /= 2, first_y /= 2, last_y /= 2;
+        l++;
+    }
+
+    const Level &level = levels[l];
+    for (int y = first_y; y <= last_y; y++)
+        for (int x = first_x; x <= last_x; x++)
+            if (!(level.depth[(size_t)y * level.width + x] > max_z)) // NaN counts as visible
+                return false;
+    return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include "DepthBuffer.h"
+
+// Hierarchical depth (Hi-Z) over an area of a DepthBuffer, for occlusion queries.
+//
+// Level 0 keeps the farthest depth of every BLOCK x BLOCK block of pixels, or
+// DepthBuffer::EMPTY if any of them is unset. Each further level halves the
+// resolution, keeping the farthest depth of 2 x 2 cells, down to a single
+// cell. Geometry whose closest depth is behind the farthest depth of every
+// cell it overlaps cannot pass the depth test anywhere.
+class DepthPyramid
+{
+public:
+    static const int BLOCK = 8;
+
+    // Covers the pixels [left, right) x [top, bottom), all cells empty
+    void resize(int left, int top, int right, int bottom);
+    void clear();
+
+    // Refreshes the cells over the pixels [left, right) x [top, bottom)
+    void update(const DepthBuffer &depth, int left, int top, int right, int bottom);
+
+    // True if a rectangle of pixel bounds with the closest depth max_z is hidden.
+    // Parts outside the covered area are ignored, they are never drawn.
+    bool occluded(float left, float top, float right, float bottom, float max_z) const;
+
+private:
+    struct Level
+    {
+        int width, height;
+        std::vector<float> depth;
+    };
+
+    int area_left = 0, area_top = 0, area_right = 0, area_bottom = 0;
+    std::vector<Level> levels;
+};
@@ -0,0 +1,159 @@
+#include "FrameProfiler.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <cmath>
+
+const char *FrameProfiler::stageName(Stage stage)
+{
+    static const char *names[STAGE_COUNT] = {"frame", "clear", "stream", "cull", "transform", "normals", "shade", "rasterize"};
+    return names[stage];
+}
+
+void FrameProfiler::setEnabled(bool enable)
+{
+    enabled = enable;
+    active = enabled || tracing;
+}
+void FrameProfiler::clear()
+{
+    history.clear();
+    hit_history.clear();
+    frames = 0;
+    last = {};
+    last_hits = {};
+    last_triangles = last_pixels = 0;
+}
+
+void FrameProfiler::beginFrame()
+{
+    if (!active)
+        return;
+    current = {};
+    current_hits = {};
+    frame_start = Clock::now();
+}
+void FrameProfiler::add(Stage stage, Clock::time_point start, Clock::time_point end)
+{
+    current[stage] += std::chrono::duration<double>(end - start).count();
+    if (tracing)
+        events.push_back({stage, start, end, current_hits[stage]});
+}
+void FrameProfiler::cacheHit(Stage stage)
+{
+    if (active)
+        current_hits[stage] = true;
+}
+void FrameProfiler::endFrame(size_t triangles, size_t pixels)
+{
+    if (!active)
+        return;
+    Clock::time_point end = Clock::now();
+    add(FRAME, frame_start, end);
+
+    last = current;
+    last_hits = current_hits;
+    last_triangles = triangles;
+    last_pixels = pixels;
+    if (history.size() < WINDOW)
+    {
+        history.push_back(current);
+        hit_history.push_back(current_hits);
+    }
+    else
+    {
+        history[frames % WINDOW] = current;
+        hit_history[frames % WINDOW] = current_hits;
+    }
+    frames++;
+    if (tracing)
+        counters.push_back({end, triangles, pixels});
+}
+
+FrameProfiler::Percentiles FrameProfiler::percentiles(Stage stage) const
+{
+    Percentiles result;
+    if (history.empty())
+        return result;
+
+    std::vector<double> times;
+    times.reserve(history.size());
+    for (const StageTimes &frame : history)
+        times.push_back(1e3 * frame[stage]);
+    std::sort(times.begin(), times.end());
+
+    // Nearest rank
+    auto rank = [&times](double p) { return times[std::max<size_t>(1, std::ceil(p * times.size())) - 1]; };
+    result.p50 = rank(0.50);
+    result.p95 = rank(0.95);
+    result.p99 = rank(0.99);
+    return result;
+}
+
+double FrameProfiler::cacheHitRate(Stage stage) const
+{
+    if (hit_history.empty())
+        return 0;
+    size_t hits = 0;
+    for (const StageHits &frame : hit_history)
+        hits += frame[stage];
+    return (double)hits / hit_history.size();
+}
+
+void FrameProfiler::startTrace()
+{
+    events.clear();
+    counters.clear();
+    trace_start = Clock::now();
+    tracing = true;
+    active = true;
+}
+void FrameProfiler::stopTrace()
+{
+    tracing = false;
+    active = enabled;
+}
+bool FrameProfiler::writeTrace(const QString &filename)
+{
+    auto microseconds = [this](Clock::time_point time)
+    { return std::chrono::duration<double, std::micro>(time - trace_start).count(); };
+
+    // Complete events ("X") of the stages, cached ones marked in their args, and counter events ("C")
+    // of every frame, all on one thread
+    QJsonArray trace;
+    QJsonObject thread_name{{"name", "thread_name"}, {"ph", "M"}, {"pid", 1}, {"tid", 1},
+                            {"args", QJsonObject{{"name", "render"}}}};
+    trace.append(thread_name);
+    for (const TraceEvent &event : events)
+    {
+        QJsonObject complete{{"name", stageName(event.stage)}, {"cat", "render"}, {"ph", "X"},
+                             {"ts", microseconds(event.start)},
+                             {"dur", std::chrono::duration<double, std::micro>(event.end - event.start).count()},
+                             {"pid", 1}, {"tid", 1}};
+        if (event.cached)
+            complete["args"] = QJsonObject{{"cached", true}};
+        trace.append(complete);
+    }
+    for (const TraceCounter &counter : counters)
+    {
+        trace.append(QJsonObject{{"name", "frame"}, {"ph", "C"}, {"ts", microseconds(counter.time)}, {"pid", 1},
+                                 {"args", QJsonObject{{"triangles", (qint64)counter.triangles},
+                                                      {"pixels", (qint64)counter.pixels}}}});
+    }
+
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        error = file.errorString();
+        return false;
+    }
+    if (file.write(QJsonDocument(QJsonObject{{"traceEvents", trace}, {"displayTimeUnit", "ms"}}).toJson(QJsonDocument::Compact)) < 0)
+    {
+        error = file.errorString();
+        return false;
+    }
+    return true;
+}
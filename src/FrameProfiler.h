@@ -0,0 +1,128 @@
+#pragma once
+
+#include <QString>
+#include <array>
+#include <chrono>
+#include <vector>
+
+// Wall time of the stages of rendering a frame, to see where a slow redraw
+// spends it. The stage times of the last WINDOW frames are kept for
+// percentiles; while tracing, every timed stage is also kept as an event that
+// writeTrace() saves in the Chrome trace format (chrome://tracing, Perfetto).
+// A disabled profiler reads no clocks, timing a stage then costs a test of a
+// flag. Stages the renderer took from the frame before are counted as cache
+// hits.
+class FrameProfiler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum Stage
+    {
+        FRAME,     // the whole frame
+        CLEAR,     // image and depth buffer
+        STREAM,    // refilling the window of a streamed terrain
+        CULL,      // frustum culling, level of detail and bounds of heightfield chunks
+        TRANSFORM, // vertices to the screen
+        NORMALS,   // face and vertex normals
+        SHADE,     // calculateColors()
+        RASTERIZE, // faces clipped and drawn, with occlusion culling
+        STAGE_COUNT
+    };
+    static const char *stageName(Stage stage);
+
+    static const int WINDOW = 256; // frames the percentiles are taken over
+
+    struct Percentiles
+    {
+        double p50 = 0, p95 = 0, p99 = 0; // in ms
+    };
+
+    void setEnabled(bool enable);
+    bool isEnabled() const { return active; } // also while tracing
+    void clear(); // forgets the recorded frames
+
+    // Called by the renderer around a frame and its stages
+    void beginFrame();
+    void add(Stage stage, Clock::time_point start, Clock::time_point end);
+    void cacheHit(Stage stage); // the stage was skipped, its results were still valid
+    void endFrame(size_t triangles, size_t pixels);
+
+    size_t frameCount() const { return frames; } // recorded since the last clear()
+    double lastTime(Stage stage) const { return 1e3 * last[stage]; } // in ms
+    size_t lastTriangles() const { return last_triangles; }
+    size_t lastPixels() const { return last_pixels; }
+    bool lastCacheHit(Stage stage) const { return last_hits[stage]; }
+    Percentiles percentiles(Stage stage) const;
+    double cacheHitRate(Stage stage) const; // share of the frames of the window, 0 to 1
+
+    // Trace of the frames rendered between startTrace() and stopTrace()
+    void startTrace();
+    void stopTrace();
+    bool isTracing() const { return tracing; }
+    bool writeTrace(const QString &filename);
+    QString errorString() const { return error; } // why writeTrace() failed
+
+private:
+    typedef std::array<double, STAGE_COUNT> StageTimes; // in seconds
+    typedef std::array<bool, STAGE_COUNT> StageHits;
+
+    struct TraceEvent
+    {
+        Stage stage;
+        Clock::time_point start, end;
+        bool cached;
+    };
+    struct TraceCounter
+    {
+        Clock::time_point time;
+        size_t triangles, pixels;
+    };
+
+    bool enabled = false, tracing = false, active = false;
+
+    Clock::time_point frame_start;
+    StageTimes current = {}; // frame being rendered
+    StageTimes last = {};
+    StageHits current_hits = {}, last_hits = {};
+    size_t last_triangles = 0, last_pixels = 0;
+    std::vector<StageTimes> history; // ring of the last WINDOW frames
+    std::vector<StageHits> hit_history; // same frames
+    size_t frames = 0;
+
+    Clock::time_point trace_start;
+    std::vector<TraceEvent> events;
+    std::vector<TraceCounter> counters;
+    QString error;
+};
+
+// Times a stage from construction to destruction or to next(), which goes
+// on with another stage
+class ProfileScope
+{
+public:
+    ProfileScope(FrameProfiler &profiler, FrameProfiler::Stage stage)
+        : profiler(profiler.isEnabled() ? &profiler : nullptr), stage(stage)
+    {
+        if (this->profiler)
+            start = FrameProfiler::Clock::now();
+    }
+    ~ProfileScope() { next(stage); }
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+    void next(FrameProfiler::Stage next_stage)
+    {
+        if (!profiler)
+            return;
+        FrameProfiler::Clock::time_point now = FrameProfiler::Clock::now();
+        profiler->add(stage, start, now);
+        stage = next_stage;
+        start = now;
+    }
+
+private:
+    FrameProfiler *profiler;
+    FrameProfiler::Stage stage;
+    FrameProfiler::Clock::time_point start;
+};
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <QtGui>
+
+struct GridTriangle
+{
+    unsigned a, b, c; // vertex indices
+};
+
+// Regular grid given by its heights alone, as loaded from a DEM: vertex
+// (row, col) lies at (origin_x + col * spacing_x, origin_y + row * spacing_y).
+// The samples stay wherever the loader keeps them, possibly a file mapped
+// as is, so rows may run in either direction and heights be stored as
+// big-endian 16-bit integers.
+struct HeightGrid
+{
+    enum SampleFormat
+    {
+        FLOAT32,
+        INT16_BIG_ENDIAN
+    };
+
+    int rows = 0, cols = 0;
+    double origin_x = 0, origin_y = 0;
+    double spacing_x = 1, spacing_y = 1;
+    const void *samples = nullptr; // row 0, owned by the loader
+    ptrdiff_t row_step = 0;        // samples from one row to the next
+    SampleFormat format = FLOAT32;
+    bool has_nodata = false;
+    int nodata = 0;         // integer sample marking a missing height
+    float nodata_height = 0; // drawn in its place
+
+    bool isEmpty() const { return samples == nullptr || rows == 0 || cols == 0; }
+    float height(int row, int col) const
+    {
+        ptrdiff_t i = row * row_step + col;
+        if (format == FLOAT32)
+            return static_cast<const float *>(samples)[i];
+
+        const uchar *bytes = static_cast<const uchar *>(samples) + 2 * i;
+        int value = (int16_t)(bytes[0] << 8 | bytes[1]);
+        return has_nodata && value == nodata ? nodata_height : value;
+    }
+    QVector3D point(int row, int col) const
+    {
+        return QVector3D(origin_x + col * spacing_x, origin_y + row * spacing_y, height(row, col));
+    }
+};
+
+// Regular grid terrain mesh stored as structure of arrays.
+//
+// Vertex (row, col) lives at index row * cols + col. Topology is implicit:
+// cell (row, col) with row, col >= 1 is split into two triangles along the
+// diagonal from (row - 1, col - 1) to (row, col), so no edges or faces are
+// stored at all.
+class HeightfieldMesh
+{
+public:
+    int rows = 0;
+    int cols = 0;
+    std::vector<float> x, y, z;
+    std::vector<QRgb> color;
+
+    HeightfieldMesh() {}
+    HeightfieldMesh(int rows, int cols) { resize(rows, cols); }
+
+    void resize(int new_rows, int new_cols)
+    {
+        rows = new_rows;
+        cols = new_cols;
+        size_t n = (size_t)rows * cols;
+        x.assign(n, 0);
+        y.assign(n, 0);
+        z.assign(n, 0);
+        color.assign(n, 0);
+    }
+    void clear()
+    {
+        rows = cols = 0;
+        x.clear();
+        y.clear();
+        z.clear();
+        color.clear();
+    }
+    bool isEmpty() const { return x.empty(); }
+
+    //// Topology ////
+    size_t vertexCount() const { return x.size(); }
+    size_t cellCount() const { return rows < 2 || cols < 2 ? 0 : (size_t)(rows - 1) * (cols - 1); }
+    size_t triangleCount() const { return 2 * cellCount(); }
+    unsigned index(int row, int col) const { return row * cols + col; }
+    size_t cellIndex(int row, int col) const { return (size_t)(row - 1) * (cols - 1) + (col - 1); } // row, col >= 1
+
+    // Vertex indices of triangle t, t = 2 * cell + {0, 1}
+    void triangle(size_t t, unsigned &a, unsigned &b, unsigned &c) const
+    {
+        size_t cell = t / 2;
+        int row = cell / (cols - 1) + 1;
+        int col = cell % (cols - 1) + 1;
+        a = index(row - 1, col - 1);
+        if (t % 2 == 0)
+        {
+            b = index(row - 1, col);
+            c = index(row, col);
+        }
+        else
+        {
+            b = index(row, col);
+            c = index(row, col - 1);
+        }
+    }
+
+    // Sides of a block of cells, for blockTriangles()
+    enum BlockSide
+    {
+        TOP,    // first_row
+        RIGHT,  // last_col
+        BOTTOM, // last_row
+        LEFT    // first_col
+    };
+
+    // Appends the triangles of the block between the vertex rows first_row .. last_row
+    // and columns first_col .. last_col using only every step-th row and column (both
+    // spans must be multiples of step). At step 1 they are the block's triangles as
+    // given by triangle(), cell by cell.
+    //
+    // A neighbouring block drawn with a larger step along a side (side_steps[BlockSide])
+    // lacks some of this block's vertices on that side. They are merged into the
+    // preceding vertex on the side, so both blocks share the same edges and no cracks
+    // open between them; triangles collapsed by the merge are left out.
+    void blockTriangles(int first_row, int last_row, int first_col, int last_col, int step,
+                        const int side_steps[4], std::vector<GridTriangle> &triangles) const
+    {
+        auto snap = [&](int offset, int side)
+        { return side_steps[side] > step ? offset / side_steps[side] * side_steps[side] : offset; };
+        auto vertex = [&](int row, int col)
+        {
+            if (row == first_row)
+                col = first_col + snap(col - first_col, TOP);
+            else if (row == last_row)
+                col = first_col + snap(col - first_col, BOTTOM);
+            if (col == first_col)
+                row = first_row + snap(row - first_row, LEFT);
+            else if (col == last_col)
+                row = first_row + snap(row - first_row, RIGHT);
+            return index(row, col);
+        };
+        auto add = [&](unsigned a, unsigned b, unsigned c)
+        {
+            if (a != b && b != c && a != c)
+                triangles.push_back({a, b, c});
+        };
+
+        for (int row = first_row + step; row <= last_row; row += step)
+        {
+            bool border_row = row == first_row + step || row == last_row;
+            for (int col = first_col + step; col <= last_col; col += step)
+            {
+                if (!border_row && col != first_col + step && col != last_col)
+                {
+                    unsigned a = index(row - step, col - step), c = index(row, col);
+                    triangles.push_back({a, index(row - step, col), c});
+                    triangles.push_back({a, c, index(row, col - step)});
+                    continue;
+                }
+                unsigned a = vertex(row - step, col - step), c = vertex(row, col);
+                add(a, vertex(row - step, col), c);
+                add(a, c, vertex(row, col - step));
+            }
+        }
+    }
+
+    //// Geometry ////
+    QVector3D position(unsigned i) const { return QVector3D(x[i], y[i], z[i]); }
+    QVector3D faceNormal(size_t t) const
+    {
+        unsigned a, b, c;
+        triangle(t, a, b, c);
+        QVector3D v1 = position(a), v2 = position(b), v3 = position(c);
+        return QVector3D::crossProduct(v2 - v1, v3 - v2);
+    }
+    QVector3D faceCenter(size_t t) const
+    {
+        unsigned a, b, c;
+        triangle(t, a, b, c);
+        return (position(a) + position(b) + position(c)) / 3;
+    }
+
+    void translate(QVector3D offset)
+    {
+        for (size_t i = 0; i < x.size(); i++)
+        {
+            x[i] += offset.x();
+            y[i] += offset.y();
+            z[i] += offset.z();
+        }
+    }
+    void scale(double factor)
+    {
+        for (size_t i = 0; i < x.size(); i++)
+        {
+            x[i] *= factor;
+            y[i] *= factor;
+            z[i] *= factor;
+        }
+    }
+    void scaleZ(double factor)
+    {
+        for (float &value : z)
+            value *= factor;
+    }
+    void recolor(QColor new_color)
+    {
+        std::fill(color.begin(), color.end(), new_color.rgb());
+    }
+};
@@ -1,16 +1,28 @@
 #pragma once
 
-#include <QtWidgets>
+#include <QtGui>
 
 class Edge;
 class Face;
 
+// Mix of two packed colors, t = 0 gives from and t = 1 gives to
+inline QRgb interpolateRgb(QRgb from, QRgb to, double t)
+{
+    auto channel = [t](int a, int b)
+    {
+        double value = a + (b - a) * t;
+        return value <= 0 ? 0 : value >= 255 ? 255 : (int)value;
+    };
+    return qRgb(channel(qRed(from), qRed(to)), channel(qGreen(from), qGreen(to)), channel(qBlue(from), qBlue(to)));
+}
+
 class Vertex
 {
 public:
     double x, y, z;
     std::vector<Edge *> edges;
-    QColor color;
+    QRgb color = 0; // packed ARGB32, see interpolateRgb()
+    unsigned int index = 0; // position in ThreeDObject::vertices
 
     QVector3D toVector3D() const { return QVector3D(x, y, z); }
     QPoint toPoint() const { return QPoint((int)x + 0.5, (int)y + 0.5); }
@@ -31,11 +43,7 @@ public:
         result.x = x + (other.x - x) * t;
         result.y = y + (other.y - y) * t;
         result.z = z + (other.z - z) * t;
-        result.color =
-            QColor(
-                color.red() + (other.color.red() - color.red()) * t,
-                color.green() + (other.color.green() - color.green()) * t,
-                color.blue() + (other.color.blue() - color.blue()) * t);
+        result.color = interpolateRgb(color, other.color, t);
         return result;
     }
 };
@@ -53,7 +61,8 @@ class Face
 {
 public:
     Edge *edge;
-    QColor color;
+    QRgb color = 0;
+    unsigned int index = 0; // position in ThreeDObject::faces
 
     QVector3D center() const
     {
@@ -95,6 +104,7 @@ public:
             newVertex.y = v.y;
             newVertex.z = v.z;
             newVertex.color = v.color;
+            newVertex.index = v.index;
             vertices.push_back(newVertex);
             vertexMap[&v] = &vertices.back();
         }
@@ -105,6 +115,7 @@ public:
         {
             Face newFace;
             newFace.color = f.color;
+            newFace.index = f.index;
             faces.push_back(newFace);
             faceMap[&f] = &faces.back();
         }
@@ -143,6 +154,89 @@ public:
         }
     }
 
+    // Build the half-edge structure from indexed polygons in O(V + E).
+    // Vertices are looked up through an index table and pair edges are
+    // matched through a hash table keyed on (origin, end) vertex indices.
+    void build(const std::vector<QVector3D> &points, const std::vector<std::vector<unsigned int>> &polygons, QColor color)
+    {
+        clear();
+
+        // Load vertices
+        std::vector<Vertex *> vertexTable(points.size());
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            Vertex vertex;
+            vertex.x = points[i].x();
+            vertex.y = points[i].y();
+            vertex.z = points[i].z();
+            vertex.color = color.rgb();
+            vertex.index = i;
+            vertices.push_back(vertex);
+            vertexTable[i] = &vertices.back();
+        }
+
+        size_t edgeCount = 0;
+        for (const std::vector<unsigned int> &polygon : polygons)
+            edgeCount += polygon.size();
+
+        // Edges waiting for their pair, keyed by (origin, end)
+        std::unordered_map<uint64_t, Edge *> unpaired;
+        unpaired.reserve(edgeCount);
+
+        // Load edges and faces
+        for (const std::vector<unsigned int> &polygon : polygons)
+        {
+            faces.push_back(Face());
+            Face *face_ptr = &faces.back();
+            face_ptr->color = color.rgb();
+            face_ptr->index = faces.size() - 1;
+
+            Edge *prev_edge = nullptr;
+            for (size_t j = 0; j < polygon.size(); j++)
+            {
+                edges.push_back(Edge());
+                Edge *edge = &edges.back();
+                edge->pair = nullptr;
+
+                // Origin
+                edge->origin = vertexTable[polygon[j]];
+                edge->origin->edges.push_back(edge);
+
+                // Face
+                edge->face = face_ptr;
+                if (j == 0)
+                    face_ptr->edge = edge;
+
+                // Linking
+                if (prev_edge != nullptr)
+                {
+                    prev_edge->next = edge;
+                    edge->prev = prev_edge;
+                }
+
+                // Pairing
+                uint64_t start = polygon[j];
+                uint64_t end = polygon[(j + 1) % polygon.size()];
+                auto it = unpaired.find(end << 32 | start);
+                if (it != unpaired.end())
+                {
+                    edge->pair = it->second;
+                    it->second->pair = edge;
+                    unpaired.erase(it);
+                }
+                else
+                {
+                    unpaired.emplace(start << 32 | end, edge);
+                }
+
+                prev_edge = edge;
+            }
+            // Linking last edge
+            prev_edge->next = face_ptr->edge;
+            face_ptr->edge->prev = prev_edge;
+        }
+    }
+
     void clear()
     {
         vertices.clear();
@@ -178,11 +272,11 @@ public:
     {
         for (auto &v : vertices)
         {
-            v.color = color;
+            v.color = color.rgb();
         }
         for (auto &f : faces)
         {
-            f.color = color;
+            f.color = color.rgb();
         }
     }
 };
\ No newline at end of file
@@ -0,0 +1,2109 @@
+#include "Renderer.h"
+
+#include <atomic>
+
+uint64_t RenderMeshes::nextVersion()
+{
+    static std::atomic<uint64_t> version(0);
+    return ++version;
+}
+
+Renderer::Renderer(QSize size)
+{
+    if (size != QSize(0, 0))
+        resize(size);
+}
+
+// Image functions
+void Renderer::setImage(const QImage &image)
+{
+    img = image;
+    stage_keys.image = false;
+    if (isEmpty())
+        return;
+
+    setDataPtr();
+    resizeBuffers();
+}
+void Renderer::resize(QSize size)
+{
+    setImage(QImage(size, QImage::Format_ARGB32));
+    if (!isEmpty())
+        clearBuffers();
+}
+void Renderer::swapImage(QImage &other)
+{
+    img.swap(other);
+    if (!isEmpty())
+        setDataPtr();
+}
+
+bool Renderer::isPolygonInside(std::list<Vertex> polygon)
+{
+    for (std::list<Vertex>::iterator i = polygon.begin(); i != polygon.end(); ++i)
+    {
+        if (isInside(*i))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// void Renderer::setPixel(int x, int y, uchar r, uchar g, uchar b, uchar a)
+// {
+//     r = r > 255 ? 255 : (r < 0 ? 0 : r);
+//     g = g > 255 ? 255 : (g < 0 ? 0 : g);
+//     b = b > 255 ? 255 : (b < 0 ? 0 : b);
+//     a = a > 255 ? 255 : (a < 0 ? 0 : a);
+//     size_t startbyte = y * img.bytesPerLine() + x * 4;
+//     data[startbyte] = b;
+//     data[startbyte + 1] = g;
+//     data[startbyte + 2] = r;
+//     data[startbyte + 3] = a;
+// }
+// void Renderer::setPixel(int x, int y, double valR, double valG, double valB, double valA)
+// {
+//     valR = valR > 1 ? 1 : (valR < 0 ? 0 : valR);
+//     valG = valG > 1 ? 1 : (valG < 0 ? 0 : valG);
+//     valB = valB > 1 ? 1 : (valB < 0 ? 0 : valB);
+//     valA = valA > 1 ? 1 : (valA < 0 ? 0 : valA);
+//     size_t startbyte = y * img.bytesPerLine() + x * 4;
+//     data[startbyte] = static_cast<uchar>(255 * valB);
+//     data[startbyte + 1] = static_cast<uchar>(255 * valG);
+//     data[startbyte + 2] = static_cast<uchar>(255 * valR);
+//     data[startbyte + 3] = static_cast<uchar>(255 * valA);
+// }
+void Renderer::setGlobalColor(QColor color)
+{
+    global_color = color;
+    meshes->object.recolor(color);
+    meshes->grid.recolor(color);
+    meshes->colors = RenderMeshes::nextVersion();
+}
+
+//// OBJECT ////
+
+// Color of a point at relative height t in <0, 1>
+static QColor heightColor(double t)
+{
+    typedef struct
+    {
+        double t;
+        QColor color;
+    } Color;
+
+    static const Color gradient[] = {
+        {0.0, QColor(255, 0, 0)},   // red
+        {0.5, QColor(255, 255, 0)}, // yellow
+        {1.0, QColor(0, 255, 0)},   // green
+    };
+
+    for (int i = 1; i < 3; i++)
+    {
+        if (gradient[i - 1].t <= t && t <= gradient[i].t)
+        {
+            double dt = (t - gradient[i - 1].t) / (gradient[i].t - gradient[i - 1].t);
+            return QColor::fromRgbF(
+                gradient[i - 1].color.redF() * (1 - dt) + gradient[i].color.redF() * dt,
+                gradient[i - 1].color.greenF() * (1 - dt) + gradient[i].color.greenF() * dt,
+                gradient[i - 1].color.blueF() * (1 - dt) + gradient[i].color.blueF() * dt);
+        }
+    }
+    return QColor();
+}
+
+void Renderer::debugObject(ThreeDObject &object)
+{
+    for (std::list<Face>::iterator it = object.faces.begin(); it != object.faces.end(); ++it)
+    {
+        Face *face_ptr = &(*it);
+        Edge *edge = face_ptr->edge;
+        qDebug() << "Face" << face_ptr << ":";
+        while (true)
+        {
+            // qDebug() << "\tEdge" << edge << ":";
+            qDebug() << "\tVrchol start: (" << edge->origin->x << ", " << edge->origin->y << ", " << edge->origin->z << ")";
+            // qDebug() << "\tVrchol start: (" << edge->next->origin->x << ", " << edge->next->origin->y << ", " << edge->next->origin->z << ")";
+            // qDebug() << "\tFace ptr: " << edge->face;
+            // qDebug() << "\tEdge next: " << edge->next;
+            // qDebug() << "\tEdge prev: " << edge->prev;
+            // qDebug() << "\tEdge pair: " << edge->pair;
+            // qDebug() << "";
+            edge = edge->next;
+            if (edge == face_ptr->edge)
+                break;
+        }
+        qDebug() << "---------------------";
+    }
+}
+void Renderer::loadObject(const std::vector<QVector3D> &vertices, const std::vector<std::vector<unsigned int>> &polygons)
+{
+    stopStreaming();
+    meshes = std::make_shared<RenderMeshes>(); // renderers sharing the old ones keep them
+    normals.invalidate(); // the new meshes may be where freed ones were
+    ThreeDObject &object = meshes->object;
+    object.build(vertices, polygons, global_color);
+
+    //// Tranform the object for nicer viewing ////
+    float minX = std::numeric_limits<float>::max();
+    float minY = std::numeric_limits<float>::max();
+    float minZ = std::numeric_limits<float>::max();
+    float maxX = -std::numeric_limits<float>::max();
+    float maxY = -std::numeric_limits<float>::max();
+    float maxZ = -std::numeric_limits<float>::max();
+
+    for (const Vertex &vertex : object.vertices)
+    {
+        if (vertex.x < minX)
+            minX = vertex.x;
+        if (vertex.x > maxX)
+            maxX = vertex.x;
+        if (vertex.y < minY)
+            minY = vertex.y;
+        if (vertex.y > maxY)
+            maxY = vertex.y;
+        if (vertex.z < minZ)
+            minZ = vertex.z;
+        if (vertex.z > maxZ)
+            maxZ = vertex.z;
+    }
+
+    // Scale the object to fit the screen nicely
+    double scaleX = 0.5 * std::fabs(img.width() / (maxX - minX + std::numeric_limits<float>::min()));
+    double scaleY = 0.5 * std::fabs(img.height() / (maxY - minY + std::numeric_limits<float>::min()));
+    double scale = std::min(scaleX, scaleY);
+    double scaleZ = 0.5 * std::fabs(std::min(img.height(), img.width()) / (maxZ - minZ + std::numeric_limits<float>::min()));
+
+    // Add colors based on z
+    for (Vertex &vertex : object.vertices)
+    {
+        QColor color = heightColor((vertex.z - minZ) / (maxZ - minZ));
+        if (color.isValid())
+            vertex.color = color.rgb();
+    }
+
+    for (Face &face : object.faces)
+    {
+        face.color = face.edge->origin->color;
+    }
+
+    // Translate object to the middle of the coordinate system
+    float x = (maxX + minX) / 2;
+    float y = (maxY + minY) / 2;
+    float z = (maxZ + minZ) / 2;
+
+    translateObject(QVector3D(-x, -y, -z));
+    object.scale(scale);
+    object.scaleZ(scaleZ / scale);
+}
+void Renderer::loadHeightfield(const std::vector<QVector3D> &points, int rows, int cols)
+{
+    stopStreaming();
+    meshes = std::make_shared<RenderMeshes>();
+    normals.invalidate();
+    HeightfieldMesh &grid = meshes->grid;
+    grid.resize(rows, cols);
+    for (size_t i = 0; i < grid.vertexCount(); i++)
+    {
+        grid.x[i] = points[i].x();
+        grid.y[i] = points[i].y();
+        grid.z[i] = points[i].z();
+    }
+    fitHeightfield();
+}
+void Renderer::loadHeightfield(const HeightGrid &heights)
+{
+    stopStreaming();
+    meshes = std::make_shared<RenderMeshes>();
+    normals.invalidate();
+    HeightfieldMesh &grid = meshes->grid;
+    grid.resize(heights.rows, heights.cols);
+    for (int row = 0, i = 0; row < heights.rows; row++)
+    {
+        float y = heights.origin_y + row * heights.spacing_y;
+        for (int col = 0; col < heights.cols; col++, i++)
+        {
+            grid.x[i] = heights.origin_x + col * heights.spacing_x;
+            grid.y[i] = y;
+            grid.z[i] = heights.height(row, col);
+        }
+    }
+    fitHeightfield();
+}
+// Colors the loaded grid by height and fits it to the screen
+void Renderer::fitHeightfield()
+{
+    HeightfieldMesh &grid = meshes->grid;
+    float minX = std::numeric_limits<float>::max();
+    float minY = std::numeric_limits<float>::max();
+    float minZ = std::numeric_limits<float>::max();
+    float maxX = -std::numeric_limits<float>::max();
+    float maxY = -std::numeric_limits<float>::max();
+    float maxZ = -std::numeric_limits<float>::max();
+
+    for (size_t i = 0; i < grid.vertexCount(); i++)
+    {
+        minX = std::min(minX, grid.x[i]);
+        maxX = std::max(maxX, grid.x[i]);
+        minY = std::min(minY, grid.y[i]);
+        maxY = std::max(maxY, grid.y[i]);
+        minZ = std::min(minZ, grid.z[i]);
+        maxZ = std::max(maxZ, grid.z[i]);
+    }
+
+    // Scale the object to fit the screen nicely
+    double scaleX = 0.5 * std::fabs(img.width() / (maxX - minX + std::numeric_limits<float>::min()));
+    double scaleY = 0.5 * std::fabs(img.height() / (maxY - minY + std::numeric_limits<float>::min()));
+    double scale = std::min(scaleX, scaleY);
+    double scaleZ = 0.5 * std::fabs(std::min(img.height(), img.width()) / (maxZ - minZ + std::numeric_limits<float>::min()));
+
+    // Add colors based on z
+    for (size_t i = 0; i < grid.vertexCount(); i++)
+    {
+        QColor color = heightColor((grid.z[i] - minZ) / (maxZ - minZ));
+        grid.color[i] = color.isValid() ? color.rgb() : global_color.rgb();
+    }
+
+    // Translate object to the middle of the coordinate system
+    grid.translate(QVector3D(-(maxX + minX) / 2, -(maxY + minY) / 2, -(maxZ + minZ) / 2));
+    grid.scale(scale);
+    grid.scaleZ(scaleZ / scale);
+    meshes->chunk_tree.build(grid, CHUNK_CELLS);
+}
+void Renderer::translateObject(QVector3D offset)
+{
+    meshes->object.translate(offset);
+    meshes->grid.translate(offset);
+    meshes->chunk_tree.build(meshes->grid, CHUNK_CELLS);
+    meshes->geometry = RenderMeshes::nextVersion();
+}
+void Renderer::loadStreamedTerrain(std::shared_ptr<TerrainStreamer> terrain)
+{
+    stopStreaming();
+    meshes = std::make_shared<RenderMeshes>(); // the window, never shared
+    normals.invalidate();
+    if (!terrain)
+        return;
+
+    const TilePyramidHeader &info = terrain->pyramid().info();
+    double x0 = info.origin_x, x1 = info.origin_x + (info.cols - 1) * info.spacing_x;
+    double y0 = info.origin_y, y1 = info.origin_y + (info.rows - 1) * info.spacing_y;
+
+    // Same fit to the screen as loadHeightfield(), but for the whole terrain
+    double scaleX = 0.5 * std::fabs(img.width() / (std::fabs(x1 - x0) + std::numeric_limits<float>::min()));
+    double scaleY = 0.5 * std::fabs(img.height() / (std::fabs(y1 - y0) + std::numeric_limits<float>::min()));
+    stream_scale = std::min(scaleX, scaleY);
+    stream_scale_z = 0.5 * std::fabs(std::min(img.height(), img.width()) / (info.max_z - info.min_z + std::numeric_limits<float>::min()));
+    stream_center = QVector3D((x0 + x1) / 2, (y0 + y1) / 2, (info.min_z + info.max_z) / 2);
+
+    streamer = terrain;
+    window = TerrainWindow();
+}
+void Renderer::shareMeshes(const Renderer &other)
+{
+    stopStreaming();
+    meshes = other.streamer ? std::make_shared<RenderMeshes>() : other.meshes;
+    normals.invalidate();
+}
+void Renderer::stopStreaming()
+{
+    // Whoever was told about its tiles is not any more
+    if (streamer)
+        streamer->setLoadedCallback(nullptr);
+    streamer.reset();
+}
+
+//// DRAWING ////
+
+// Draw Line functions
+void Renderer::drawLine(Vertex start, Vertex end)
+{
+    if (start.toVector3D() == end.toVector3D())
+        return;
+    if (!isInside(start) && !isInside(end))
+        return;
+    if (!isInside(start) || !isInside(end))
+    {
+        Vertex tmp_start = start;
+        Vertex tmp_end = end;
+        clipLine(tmp_start, tmp_end, start, end);
+    }
+    if (frame.rasterizationAlgorithm == RasterizationAlgorithm::BRESENHAMM)
+    {
+        Bresenhamm(start, end);
+    }
+    else
+    {
+        Dda(start, end);
+    }
+}
+
+void Renderer::Dda(Vertex start, Vertex end)
+{
+    float d_x = end.x - start.x;
+    float d_y = end.y - start.y;
+    double m = DBL_MAX;
+
+    if (d_x != 0)
+        m = d_y / d_x;
+
+    if (-1 < m && m < 1)
+    {
+        if (start.x < end.x)
+        {
+            Dda_x(start, end, m);
+        }
+        else
+        {
+            Dda_x(end, start, m);
+        }
+    }
+    else
+    {
+        if (start.y < end.y)
+        {
+            Dda_y(start, end, 1 / m);
+        }
+        else
+        {
+            Dda_y(end, start, 1 / m);
+        }
+    }
+}
+void Renderer::Dda_x(Vertex start, Vertex end, double m)
+{
+
+    setPixel(start);
+
+    int x;
+    double y = start.y;
+
+    for (x = start.x; x < end.x; x++)
+    {
+        y += m;
+        Vertex p = start.interpolate(end, (x - start.x) / (end.x - start.x));
+        p.x = x;
+        p.y = (int)(y + 0.5);
+        setPixel(p);
+    }
+}
+void Renderer::Dda_y(Vertex start, Vertex end, double w)
+{
+
+    setPixel(start);
+
+    int y;
+    double x = start.x;
+
+    for (y = start.y; y < end.y; y++)
+    {
+        x += w;
+        double t = (y - start.y) / (end.y - start.y);
+        Vertex p = start.interpolate(end, (y - start.y) / (end.y - start.y));
+        p.x = (int)(x + 0.5);
+        p.y = y;
+        setPixel(p);
+    }
+}
+
+void Renderer::Bresenhamm(Vertex start, Vertex end)
+{
+    float d_x = end.x - start.x;
+    float d_y = end.y - start.y;
+    double m = DBL_MAX;
+
+    if (d_x != 0)
+        m = d_y / d_x;
+
+    if (-1 < m && m < 1)
+    {
+        if (start.x < end.x)
+        {
+            Bresenhamm_x(start, end, m);
+        }
+        else
+        {
+            Bresenhamm_x(end, start, m);
+        }
+    }
+    else
+    {
+        if (start.y < end.y)
+        {
+            Bresenhamm_y(start, end, m);
+        }
+        else
+        {
+            Bresenhamm_y(end, start, m);
+        }
+    }
+}
+void Renderer::Bresenhamm_x(Vertex start, Vertex end, double m)
+{
+    if (m > 0)
+    {
+        int k1 = 2 * (end.y - start.y);
+        int k2 = k1 - 2 * (end.x - start.x);
+        int p = k1 - (end.x - start.x);
+
+        int x = start.x + 0.5;
+        int y = start.y + 0.5;
+
+        setPixel(start);
+
+        for (; x < end.x; x++)
+        {
+            if (p > 0)
+            {
+                y++;
+                p += k2;
+            }
+            else
+            {
+                p += k1;
+            }
+            Vertex p = start.interpolate(end, (x - start.x) / (end.x - start.x));
+            p.x = x;
+            p.y = y;
+            setPixel(p);
+        }
+    }
+    else
+    {
+        int k1 = 2 * (end.y - start.y);
+        int k2 = k1 + 2 * (end.x - start.x);
+        int p = k1 + (end.x - start.x);
+
+        int x = start.x + 0.5;
+        ;
+        int y = start.y + 0.5;
+        ;
+
+        setPixel(start);
+
+        for (; x < end.x; x++)
+        {
+            if (p < 0)
+            {
+                y--;
+                p += k2;
+            }
+            else
+            {
+                p += k1;
+            }
+            Vertex p = start.interpolate(end, (x - start.x) / (end.x - start.x));
+            p.x = x;
+            p.y = y;
+            setPixel(p);
+        }
+    }
+}
+void Renderer::Bresenhamm_y(Vertex start, Vertex end, double m)
+{
+    if (m > 0)
+    {
+        int k1 = 2 * (end.x - start.x);
+        int k2 = k1 - 2 * (end.y - start.y);
+        int p = k1 - (end.y - start.y);
+
+        int x = start.x + 0.5;
+        ;
+        int y = start.y + 0.5;
+        ;
+
+        setPixel(start);
+
+        for (; y < end.y; y++)
+        {
+            if (p > 0)
+            {
+                x++;
+                p += k2;
+            }
+            else
+            {
+                p += k1;
+            }
+            Vertex p = start.interpolate(end, (y - start.y) / (end.y - start.y));
+            p.x = x;
+            p.y = y;
+            setPixel(p);
+        }
+    }
+    else
+    {
+        int k1 = 2 * (end.x - start.x);
+        int k2 = k1 + 2 * (end.y - start.y);
+        int p = k1 + (end.y - start.y);
+
+        int x = start.x + 0.5;
+        ;
+        int y = start.y + 0.5;
+        ;
+
+        setPixel(start);
+
+        for (; y < end.y; y++)
+        {
+            if (p < 0)
+            {
+                x--;
+                p += k2;
+            }
+            else
+            {
+                p += k1;
+            }
+            Vertex p = start.interpolate(end, (y - start.y) / (end.y - start.y));
+            p.x = x;
+            p.y = y;
+            setPixel(p);
+        }
+    }
+}
+
+// Draw polygon functions
+void Renderer::drawPolygon(std::list<Vertex> polygon, QColor color)
+{
+    for (Vertex &vertex : polygon)
+    {
+        vertex.color = color.rgb();
+    }
+    drawPolygon(polygon);
+}
+void Renderer::drawPolygon(std::list<Vertex> polygon)
+{
+    if (!isPolygonInside(polygon))
+        return;
+
+    if (polygon.size() < 2)
+        return;
+
+    if (polygon.size() == 2)
+    {
+        Vertex start, end;
+        clipLine(polygon.front(), polygon.back(), start, end);
+        drawLine(start, end);
+        return;
+    }
+    clipPolygon(polygon);
+
+    if (polygon.size() < 1)
+        return;
+
+    for (std::list<Vertex>::iterator it = polygon.begin(); it != --polygon.end();)
+    {
+        drawLine(*it, *(++it));
+    }
+    drawLine(polygon.back(), polygon.front());
+}
+void Renderer::fillPolygon(std::list<Vertex> polygon)
+{
+    if (polygon.size() < 3)
+        return;
+    if (polygon.size() == 3)
+    {
+        std::array<Vertex, 3> triangle;
+        std::copy(polygon.begin(), polygon.end(), triangle.begin());
+        if (frame.rasterizationAlgorithm == EDGE_FUNCTION)
+            rasterizeTriangle(triangle);
+        else
+            fillTriangle(triangle);
+        return;
+    }
+
+    struct Edge
+    {
+        Vertex start;
+        Vertex end;
+        int dy;
+        double x;
+        double dx;
+    };
+
+    polygon.push_back(polygon.front());
+
+    // Define sides
+    QVector<Edge> edges;
+    for (std::list<Vertex>::iterator it = polygon.begin(); it != --polygon.end(); it++)
+    {
+        Vertex start = *it;
+        Vertex end = *(++it);
+
+        // Remove horizontal lines
+        if ((int)start.y + 0.5 == (int)end.y + 0.5)
+            continue;
+
+        // Orientate the edge
+        if (start.y > end.y)
+        {
+            Vertex temp = start;
+            start = end;
+            end = temp;
+        }
+
+        Vertex new_end = end;
+        new_end.y -= 1;
+
+        Edge edge;
+        edge.start = start;
+        edge.end = new_end;
+        edge.dy = (int)edge.end.y - start.y + 0.5;
+        edge.x = start.x;
+        edge.dx = (end.x - start.x) / (end.y - start.y);
+
+        edges.push_back(edge);
+    }
+    if (edges.isEmpty()) // flat, within one row
+        return;
+
+    // Sort by y
+    std::sort(edges.begin(), edges.end(), [](Edge e1, Edge e2)
+              { return e1.start.y < e2.start.y; });
+
+    int y_min = (int)edges[0].start.y + 0.5;
+    int y_max = y_min;
+    for (int i = 0; i < edges.size(); i++)
+    {
+        if ((int)edges[i].end.y + 0.5 > y_max)
+        {
+            y_max = (int)edges[i].end.y + 0.5;
+        }
+    }
+
+    // Add edges to the edges_table
+    QVector<QList<Edge>> edges_table;
+    edges_table.resize(y_max - y_min + 1);
+    for (int i = 0; i < edges.size(); i++)
+    {
+        edges_table[edges[i].start.y - y_min].push_back(edges[i]);
+    }
+
+    // Scanline, one line at a time from the top to the bottom
+    QVector<Edge> active_edges;
+    double y = y_min;
+    for (int i = 0; i < edges_table.size(); i++)
+    {
+        // Add new edges to the active edges
+        if (edges_table[i].size() != 0)
+        {
+            for (int j = 0; j < edges_table[i].size(); j++)
+            {
+                active_edges.push_back(edges_table[i][j]);
+            }
+        }
+        // Sort active edges by x
+        std::sort(active_edges.begin(), active_edges.end(), [](Edge e1, Edge e2)
+                  { return e1.x < e2.x; });
+
+        // Draw lines between active adges
+        for (int j = 0; j < active_edges.size(); j += 2)
+        {
+            if (active_edges[j].x != active_edges[j + 1].x)
+            {
+                Vertex start = active_edges[j].start.interpolate(active_edges[j].end, (y - active_edges[j].start.y) / (active_edges[j].end.y - active_edges[j].start.y + 1));
+                start.x = active_edges[j].x;
+                start.y = y;
+
+                Vertex end = active_edges[j + 1].start.interpolate(active_edges[j + 1].end, (y - active_edges[j + 1].start.y) / (active_edges[j + 1].end.y - active_edges[j + 1].start.y + 1));
+                end.x = active_edges[j + 1].x;
+                end.y = y;
+
+                drawLine(start, end);
+            }
+        }
+
+        // Update active edges
+        for (int j = 0; j < active_edges.size(); j++)
+        {
+            // Remove edges that are done
+            if (active_edges[j].dy == 0)
+            {
+                active_edges.remove(j);
+                j--;
+            }
+            // Update edges that are not done
+            else
+            {
+                active_edges[j].x += active_edges[j].dx;
+                active_edges[j].dy--;
+            }
+        }
+
+        y++;
+    }
+}
+void Renderer::fillTriangle(std::array<Vertex, 3> polygon)
+{
+    // x and y are rounded here, to avoid rounding errors later on
+    for (auto &point : polygon)
+    {
+        point.x = (int)point.x + 0.5;
+        point.y = (int)point.y;
+    }
+
+    std::sort(polygon.begin(), polygon.end(),
+              [](Vertex a, Vertex b)
+              {
+                  if (a.y == b.y)
+                      return a.x < b.x;
+                  return a.y < b.y;
+              });
+
+    struct Edge
+    {
+        Vertex start, end;
+        double dx;
+    };
+
+    Edge e1;
+    Edge e2;
+
+    if (polygon[0].y == polygon[1].y)
+    {
+        // Filling the bottom flat triangle
+        e1.start = polygon[0];
+        e1.end = polygon[2];
+
+        e2.start = polygon[1];
+        e2.end = polygon[2];
+    }
+    else if (polygon[1].y == polygon[2].y)
+    {
+        // Filling the top flat triangle
+        e1.start = polygon[0];
+        e1.end = polygon[1];
+
+        e2.start = polygon[0];
+        e2.end = polygon[2];
+    }
+    else if (polygon[0].y == polygon[2].y)
+    {
+        // The triangle is a horizontal line, lets just skip it
+        return;
+    }
+    else
+    {
+        // Splitting the triangle into two
+        Vertex split_point(polygon[0].interpolate(polygon[2], (polygon[1].y - polygon[0].y) / (polygon[2].y - polygon[0].y)));
+
+        if (polygon[1].x < split_point.x)
+        {
+            fillTriangle({polygon[0], polygon[1], split_point});
+            fillTriangle({polygon[1], split_point, polygon[2]});
+        }
+        else
+        {
+            fillTriangle({polygon[0], split_point, polygon[1]});
+            fillTriangle({split_point, polygon[1], polygon[2]});
+        }
+        return;
+    }
+
+    if (e1.start.y == e1.end.y)
+        return;
+    if (e2.start.y == e2.end.y)
+        return;
+
+    e1.dx = (e1.end.x - e1.start.x) / (e1.end.y - e1.start.y);
+    e2.dx = (e2.end.x - e2.start.x) / (e2.end.y - e2.start.y);
+
+    double x1 = e1.start.x;
+    double x2 = e2.start.x;
+    for (int y = e1.start.y + 0.5; y < e1.end.y; y++)
+    {
+        if (x1 != x2)
+        {
+            drawLine(
+                e1.start.interpolate(e1.end, (y - e1.start.y) / (e1.end.y - e1.start.y)),
+                e2.start.interpolate(e2.end, (y - e2.start.y) / (e2.end.y - e2.start.y)));
+        }
+        x1 += e1.dx;
+        x2 += e2.dx;
+    }
+}
+
+// Normal of the triangle v1, v2, v3 (not normalized)
+static QVector3D triangleNormal(QVector3D v1, QVector3D v2, QVector3D v3)
+{
+    return QVector3D::crossProduct(v2 - v1, v3 - v2);
+}
+
+// Transformation matrices
+QVector4D Renderer::viewerPosition(const QMatrix4x4 &model_view, const Camera &camera) const
+{
+    // Center of projection, or the direction towards the viewer for a parallel projection
+    QVector4D viewer = camera.center_of_projection != 0 ? QVector4D(0, 0, camera.center_of_projection, 1)
+                                                        : QVector4D(0, 0, 1, 0);
+    return model_view.inverted() * viewer;
+}
+QMatrix4x4 Renderer::modelMatrix() const
+{
+    QMatrix4x4 model;
+    model.scale(frame.object_scale, frame.object_scale, frame.object_scale * frame.z_scale);
+    return model;
+}
+QMatrix4x4 Renderer::viewMatrix(const Camera &camera) const
+{
+    double cos_a = cos(-camera.azimuth), sin_a = sin(-camera.azimuth);
+    // M_PI / 2 to convert the angle from the angle from horizon, into angle from vertical
+    double cos_z = cos(-(M_PI / 2 - camera.zenit)), sin_z = sin(-(M_PI / 2 - camera.zenit));
+
+    // Rotate around Z axis based on azimuth
+    QMatrix4x4 azimuth(cos_a, -sin_a, 0, 0,
+                       sin_a, cos_a, 0, 0,
+                       0, 0, 1, 0,
+                       0, 0, 0, 1);
+    // Rotate around Y axis based on zenit
+    QMatrix4x4 zenit(cos_z, 0, -sin_z, 0,
+                     0, 1, 0, 0,
+                     sin_z, 0, cos_z, 0,
+                     0, 0, 0, 1);
+    // Switch axis to look from the front
+    QMatrix4x4 front(0, 1, 0, 0,
+                     -1, 0, 0, 0,
+                     0, 0, 1, 0,
+                     0, 0, 0, 1);
+
+    QMatrix4x4 translation;
+    translation.translate(-camera.position);
+    return front * zenit * azimuth * translation;
+}
+QMatrix4x4 Renderer::projectionMatrix(const Camera &camera) const
+{
+    // Perspective projection onto the plane z = 0 with the center of projection at
+    // z = center_of_projection, i.e. w = (center_of_projection - z) / center_of_projection.
+    // The depth becomes 1 / w (reversed-Z), which orders points like z does but keeps
+    // the float precision of the depth buffer for the distant ones.
+    QMatrix4x4 projection;
+    if (camera.center_of_projection != 0)
+    {
+        projection(3, 2) = -1 / camera.center_of_projection;
+        projection(2, 2) = 0;
+        projection(2, 3) = 1;
+    }
+
+    // Origin to the middle of the screen
+    QMatrix4x4 viewport;
+    viewport.translate(img.width() / 2, img.height() / 2, 0);
+    return viewport * projection;
+}
+
+size_t Renderer::rasterizeTriangle(const std::array<Vertex, 3> &triangle)
+{
+    RasterVertex v[3];
+    for (int i = 0; i < 3; i++)
+    {
+        v[i] = {(float)triangle[i].x, (float)triangle[i].y, (float)triangle[i].z, triangle[i].color};
+    }
+    size_t pixels = ::rasterizeTriangle(rasterTarget(), v[0], v[1], v[2]);
+    frame_stats.pixels_drawn += pixels;
+    return pixels;
+}
+RasterTarget Renderer::rasterTarget()
+{
+    // Same drawing area as isInside()
+    return {data, (int)img.bytesPerLine(), &depth_buffer,
+            10, 10, img.width() - 10, img.height() - 10};
+}
+
+// 3D Object
+void Renderer::drawObject(const ThreeDObject &obj, const Camera &camera, const LightSource &light, ColoringType coloring)
+{
+    if (obj.vertices.size() == 0)
+        return;
+
+    QMatrix4x4 view = viewMatrix(camera);
+    QMatrix4x4 model = modelMatrix();
+    QMatrix4x4 transform = projectionMatrix(camera) * view * model;
+    viewer = viewerPosition(view * model, camera);
+    ProfileScope scope(frame_profiler, FrameProfiler::TRANSFORM);
+    if (!isTransformKept(&obj, transform))
+    {
+        transformVertices(obj, transform);
+        keepTransform(&obj, transform);
+    }
+    scope.next(FrameProfiler::NORMALS);
+    if (!updateNormals(obj))
+        frame_profiler.cacheHit(FrameProfiler::NORMALS);
+    scope.next(FrameProfiler::SHADE);
+    Lighting lighting = prepareLighting(view, light);
+    if (coloring != WIREFRAME && !isShadingKept(coloring, lighting))
+    {
+        calculateColors(obj, lighting, coloring);
+        keepShading(coloring, lighting);
+    }
+
+    scope.next(FrameProfiler::RASTERIZE);
+    drawObject(&obj, coloring);
+}
+void Renderer::transformVertices(const ThreeDObject &object, const QMatrix4x4 &transform)
+{
+    stage_keys.transformed = 0;
+    buffers.resize(object.vertices.size(), object.faces.size());
+
+    const float *m = transform.constData();
+    for (const Vertex &vertex : object.vertices)
+    {
+        unsigned int i = vertex.index;
+        transformPoint(m, vertex.x, vertex.y, vertex.z, buffers.x[i], buffers.y[i], buffers.z[i]);
+    }
+}
+void Renderer::calculateColors(const ThreeDObject &object, const Lighting &lighting, ColoringType coloring)
+{
+    updateNormals(object); // also for back-face culling
+    stage_keys.shaded = 0;
+    QVector3D scale(frame.object_scale, frame.object_scale, frame.object_scale * frame.z_scale);
+
+    if (coloring == ColoringType::SIDE)
+    {
+        for (const Face &face : object.faces)
+        {
+            buffers.face_color[face.index] =
+                shade(face.center() * scale, normals.face[face.index], face.color, lighting);
+        }
+    }
+    else if (coloring == ColoringType::VERTEX)
+    {
+        for (const Vertex &vertex : object.vertices)
+        {
+            buffers.color[vertex.index] =
+                shade(vertex.toVector3D() * scale, normals.vertex[vertex.index], vertex.color, lighting);
+        }
+    }
+}
+bool Renderer::updateNormals(const ThreeDObject &object)
+{
+    if (normals.isValid(&object, frame.z_scale))
+        return false;
+    normals.mesh = &object;
+    normals.z_scale = frame.z_scale;
+    QVector3D scale(frame.z_scale, frame.z_scale, 1); // see MeshNormals
+
+    normals.face_object.resize(object.faces.size());
+    normals.face.resize(object.faces.size());
+    for (const Face &face : object.faces)
+    {
+        QVector3D normal = face.normal();
+        normals.face_object[face.index] = normal;
+        normals.face[face.index] = (normal * scale).normalized();
+    }
+
+    // Sum of the normals of the corners around the vertex
+    normals.vertex.resize(object.vertices.size());
+    for (const Vertex &vertex : object.vertices)
+    {
+        QVector3D normal;
+        for (const Edge *edge : vertex.edges)
+        {
+            normal += triangleNormal(edge->origin->toVector3D(), edge->next->origin->toVector3D(),
+                                     edge->next->next->origin->toVector3D());
+        }
+        normals.vertex[vertex.index] = (normal * scale).normalized();
+    }
+    return true;
+}
+void Renderer::drawObject(const ThreeDObject *object, ColoringType coloring)
+{
+    std::array<Vertex, 3> triangle;
+    RasterTarget target = rasterTarget();
+
+    for (const Face &face : object->faces)
+    {
+        Edge *e = face.edge;
+
+        if (isBackFacing(normals.face_object[face.index], e->origin->toVector3D(), coloring))
+        {
+            frame_stats.faces_backfacing++;
+            continue;
+        }
+
+        // Faces entirely beyond one side of the drawing area
+        int outside_left = 0, outside_right = 0, outside_top = 0, outside_bottom = 0, corners = 0;
+        do
+        {
+            unsigned int i = e->origin->index;
+            outside_left += buffers.x[i] < target.clip_left - 1;
+            outside_right += buffers.x[i] > target.clip_right + 1;
+            outside_top += buffers.y[i] < target.clip_top - 1;
+            outside_bottom += buffers.y[i] > target.clip_bottom + 1;
+            corners++;
+            e = e->next;
+        } while (e != face.edge);
+        if (outside_left == corners || outside_right == corners || outside_top == corners || outside_bottom == corners)
+        {
+            frame_stats.faces_outside++;
+            continue;
+        }
+        frame_stats.faces_drawn++;
+
+        // Triangles are drawn without building a polygon
+        if (e->next->next->next == e)
+        {
+            for (Vertex &v : triangle)
+            {
+                setScreenVertex(v, e->origin->index, coloring, face.index);
+                e = e->next;
+            }
+            drawTriangle(triangle, coloring);
+            continue;
+        }
+
+        std::list<Vertex> polygon;
+        do
+        {
+            Vertex v;
+            setScreenVertex(v, e->origin->index, coloring, face.index);
+            polygon.push_back(v);
+            e = e->next;
+        } while (e != face.edge);
+
+        if (coloring == WIREFRAME)
+        {
+            drawPolygon(polygon);
+        }
+        else if (coloring == SIDE || coloring == VERTEX)
+        {
+            fillPolygon(polygon);
+        }
+    }
+}
+
+// Heightfield
+void Renderer::drawObject(const HeightfieldMesh &mesh, const Camera &camera, const LightSource &light, ColoringType coloring)
+{
+    if (mesh.isEmpty())
+        return;
+
+    QMatrix4x4 view = viewMatrix(camera);
+    QMatrix4x4 model = modelMatrix();
+    QMatrix4x4 transform = projectionMatrix(camera) * view * model;
+    viewer = viewerPosition(view * model, camera);
+
+    // Chunks outside the view frustum are neither transformed, shaded nor drawn.
+    // Unsorted chunks are drawn as culled, ties in depth then resolve as without caching.
+    ProfileScope scope(frame_profiler, FrameProfiler::CULL);
+    bool front_to_back = coloring != WIREFRAME && frame.occlusion_culling;
+    if ((stage_keys.sorted && !front_to_back) || !isTransformKept(&mesh, transform))
+    {
+        RasterTarget target = rasterTarget();
+        buffers.chunks.clear();
+        frame_stats.chunks_outside = meshes->chunk_tree.cull(transform, target.clip_left, target.clip_top,
+                                                     target.clip_right, target.clip_bottom, buffers.chunks);
+        frame_stats.faces_outside = mesh.triangleCount();
+        for (const TerrainChunk &chunk : buffers.chunks)
+            frame_stats.faces_outside -= chunk.triangleCount();
+
+        selectLevels(transform);
+        buildChunkFaces(mesh);
+        scope.next(FrameProfiler::TRANSFORM);
+        transformVertices(mesh, transform);
+        boundChunks(mesh);
+        keepTransform(&mesh, transform);
+    }
+    if (coloring != WIREFRAME)
+    {
+        // Face normals for back-face culling and SIDE, vertex normals for VERTEX
+        scope.next(FrameProfiler::NORMALS);
+        bool computed = updateFaceNormals(mesh);
+        if (coloring == VERTEX)
+            computed = updateNormals(mesh) || computed;
+        if (!computed)
+            frame_profiler.cacheHit(FrameProfiler::NORMALS);
+    }
+    scope.next(FrameProfiler::SHADE);
+    Lighting lighting = prepareLighting(view, light);
+    if (coloring != WIREFRAME && !isShadingKept(coloring, lighting))
+    {
+        calculateColors(mesh, lighting, coloring);
+        keepShading(coloring, lighting);
+    }
+
+    scope.next(FrameProfiler::RASTERIZE);
+    if (front_to_back)
+        sortChunks();
+    drawChunks(&mesh, coloring);
+}
+void Renderer::transformVertices(const HeightfieldMesh &mesh, const QMatrix4x4 &transform)
+{
+    stage_keys.transformed = 0;
+    buffers.resize(mesh.vertexCount(), mesh.triangleCount());
+    const float *m = transform.constData();
+
+    bool full = buffers.chunks.size() == meshes->chunk_tree.chunkCount();
+    for (const TerrainChunk &chunk : buffers.chunks)
+        full = full && chunk.level == 0;
+    if (full)
+    {
+        transformPoints(m, mesh.x.data(), mesh.y.data(), mesh.z.data(),
+                        buffers.x.data(), buffers.y.data(), buffers.z.data(), mesh.vertexCount());
+        return;
+    }
+
+    // Chunk by chunk, vertices on chunk borders are transformed twice
+    for (const TerrainChunk &chunk : buffers.chunks)
+    {
+        int step = chunk.step();
+        for (int row = chunk.first_row; row <= chunk.last_row; row += step)
+        {
+            unsigned i = mesh.index(row, chunk.first_col);
+            if (step == 1)
+            {
+                transformPoints(m, &mesh.x[i], &mesh.y[i], &mesh.z[i],
+                                &buffers.x[i], &buffers.y[i], &buffers.z[i], chunk.last_col - chunk.first_col + 1);
+                continue;
+            }
+            for (int col = chunk.first_col; col <= chunk.last_col; col += step, i += step)
+                transformPoint(m, mesh.x[i], mesh.y[i], mesh.z[i], buffers.x[i], buffers.y[i], buffers.z[i]);
+        }
+    }
+}
+// Sum of the normals of the (up to 6) triangles around vertex (row, col)
+static QVector3D vertexNormal(const HeightfieldMesh &mesh, int row, int col, QVector3D scale)
+{
+    QVector3D normal;
+    auto add = [&](int cell_row, int cell_col, int first, int last)
+    {
+        if (cell_row < 1 || cell_col < 1 || cell_row >= mesh.rows || cell_col >= mesh.cols)
+            return;
+        for (size_t t = 2 * mesh.cellIndex(cell_row, cell_col) + first; t <= 2 * mesh.cellIndex(cell_row, cell_col) + last; t++)
+        {
+            unsigned a, b, c;
+            mesh.triangle(t, a, b, c);
+            normal += triangleNormal(mesh.position(a) * scale, mesh.position(b) * scale, mesh.position(c) * scale);
+        }
+    };
+    add(row + 1, col + 1, 0, 1); // vertex is the first corner of both triangles
+    add(row + 1, col, 0, 0);
+    add(row, col, 0, 1);
+    add(row, col + 1, 1, 1);
+    return normal;
+}
+void Renderer::calculateColors(const HeightfieldMesh &mesh, const Lighting &lighting, ColoringType coloring)
+{
+    stage_keys.shaded = 0;
+    QVector3D scale(frame.object_scale, frame.object_scale, frame.object_scale * frame.z_scale);
+
+    if (coloring == ColoringType::SIDE)
+    {
+        updateFaceNormals(mesh);
+        for (const TerrainChunk &chunk : buffers.chunks)
+        {
+            for (size_t f = chunk.first_face; f < chunk.first_face + chunk.face_count; f++)
+            {
+                const GridTriangle &face = buffers.faces[f];
+                QVector3D center = (mesh.position(face.a) + mesh.position(face.b) + mesh.position(face.c)) / 3;
+                buffers.face_color[f] =
+                    shade(center * scale, chunkFaceNormal(mesh, chunk, face).world, mesh.color[face.a], lighting);
+            }
+        }
+    }
+    else if (coloring == ColoringType::VERTEX)
+    {
+        // Normals of the full resolution grid, also for simplified chunks.
+        // Vertices on chunk borders are shaded once, shaded_frame marks the done ones.
+        updateNormals(mesh);
+        uint32_t stamp = buffers.nextFrame();
+        for (const TerrainChunk &chunk : buffers.chunks)
+        {
+            for (int row = chunk.first_row; row <= chunk.last_row; row += chunk.step())
+            {
+                for (int col = chunk.first_col; col <= chunk.last_col; col += chunk.step())
+                {
+                    unsigned i = mesh.index(row, col);
+                    if (buffers.shaded_frame[i] == stamp)
+                        continue;
+                    buffers.shaded_frame[i] = stamp;
+                    buffers.color[i] = shade(mesh.position(i) * scale, normals.vertex[i], mesh.color[i], lighting);
+                }
+            }
+        }
+    }
+}
+// Starts the heightfield normals over when they are of another mesh or z scale
+void Renderer::prepareNormals(const HeightfieldMesh &mesh)
+{
+    if (normals.isValid(&mesh, frame.z_scale))
+        return;
+    normals.mesh = &mesh;
+    normals.z_scale = frame.z_scale;
+    normals.vertex.resize(mesh.vertexCount());
+    normals.chunk_done.assign(meshes->chunk_tree.chunkCount(), 0);
+    normals.chunk_faces.clear();
+    normals.chunk_faces.resize((size_t)meshes->chunk_tree.chunkCount() * meshes->chunk_tree.levelCount());
+}
+bool Renderer::updateNormals(const HeightfieldMesh &mesh)
+{
+    prepareNormals(mesh);
+    QVector3D scale(1, 1, frame.z_scale); // see MeshNormals
+    bool computed = false;
+    for (const TerrainChunk &chunk : buffers.chunks)
+    {
+        if (normals.chunk_done[chunk.id])
+            continue;
+        normals.chunk_done[chunk.id] = 1;
+        computed = true;
+        for (int row = chunk.first_row; row <= chunk.last_row; row++)
+        {
+            for (int col = chunk.first_col; col <= chunk.last_col; col++)
+                normals.vertex[mesh.index(row, col)] = vertexNormal(mesh, row, col, scale).normalized();
+        }
+    }
+    return computed;
+}
+bool Renderer::updateFaceNormals(const HeightfieldMesh &mesh)
+{
+    prepareNormals(mesh);
+    QVector3D scale(frame.z_scale, frame.z_scale, 1); // see MeshNormals
+    bool computed = false;
+    for (const TerrainChunk &chunk : buffers.chunks)
+    {
+        std::vector<MeshNormals::Face> &faces =
+            normals.chunk_faces[(size_t)chunk.id * meshes->chunk_tree.levelCount() + chunk.level];
+        if (!faces.empty())
+            continue;
+        computed = true;
+
+        // The two triangles of every cell of the level, as blockTriangles() splits them
+        int step = chunk.step();
+        faces.reserve(chunk.triangleCount() / step / step);
+        for (int row = chunk.first_row + step; row <= chunk.last_row; row += step)
+        {
+            for (int col = chunk.first_col + step; col <= chunk.last_col; col += step)
+            {
+                QVector3D a = mesh.position(mesh.index(row - step, col - step)), c = mesh.position(mesh.index(row, col));
+                QVector3D first = triangleNormal(a, mesh.position(mesh.index(row - step, col)), c);
+                QVector3D second = triangleNormal(a, c, mesh.position(mesh.index(row, col - step)));
+                faces.push_back({(first * scale).normalized(), first});
+                faces.push_back({(second * scale).normalized(), second});
+            }
+        }
+    }
+    return computed;
+}
+// Normals of face, one of the triangles of chunk, from updateFaceNormals(). A
+// triangle with a corner merged to stitch a coarser neighbour is not one of
+// the level's and gets its normals computed.
+MeshNormals::Face Renderer::chunkFaceNormal(const HeightfieldMesh &mesh, const TerrainChunk &chunk,
+                                            const GridTriangle &face) const
+{
+    unsigned step = chunk.step(), row_step = step * mesh.cols;
+    if (face.a + row_step + step == face.c && (face.b == face.c - row_step || face.b == face.c - step))
+    {
+        int row = face.c / mesh.cols, col = face.c % mesh.cols;
+        int cells = (chunk.last_col - chunk.first_col) / step; // per row of the level
+        size_t cell = (size_t)((row - chunk.first_row) / step - 1) * cells + (col - chunk.first_col) / step - 1;
+        const std::vector<MeshNormals::Face> &faces =
+            normals.chunk_faces[(size_t)chunk.id * meshes->chunk_tree.levelCount() + chunk.level];
+        return faces[2 * cell + (face.b == face.c - step)];
+    }
+
+    QVector3D normal = triangleNormal(mesh.position(face.a), mesh.position(face.b), mesh.position(face.c));
+    return {(normal * QVector3D(frame.z_scale, frame.z_scale, 1)).normalized(), normal};
+}
+void Renderer::drawObject(const HeightfieldMesh *mesh, ColoringType coloring)
+{
+    if (coloring != WIREFRAME)
+        updateFaceNormals(*mesh);
+    boundChunks(*mesh);
+    if (coloring != WIREFRAME && frame.occlusion_culling)
+        sortChunks();
+    drawChunks(mesh, coloring);
+}
+// Same vertices and colors as setScreenVertex(), for the parallel rasterizer
+void Renderer::setRasterTriangle(size_t f, ColoringType coloring, RasterVertex v[3])
+{
+    const GridTriangle &face = buffers.faces[f];
+    unsigned int indices[3] = {face.a, face.b, face.c};
+    for (int k = 0; k < 3; k++)
+    {
+        unsigned int i = indices[k];
+        QRgb color = coloring == SIDE ? buffers.face_color[f] : buffers.color[i];
+        v[k] = {buffers.x[i], buffers.y[i], buffers.z[i], color | 0xff000000u};
+    }
+}
+
+// Heightfield chunks
+void Renderer::selectLevels(const QMatrix4x4 &transform)
+{
+    // A vertical error e in mesh units is at most e * zoom * z scale / w pixels on the screen
+    const float *m = transform.constData();
+    float units = frame.object_scale * frame.z_scale;
+    buffers.chunk_level.assign(meshes->chunk_tree.chunkCount(), 0);
+
+    for (TerrainChunk &chunk : buffers.chunks)
+    {
+        chunk.level = 0;
+        if (frame.lod_tolerance <= 0)
+            continue;
+
+        QVector3D min, max;
+        meshes->chunk_tree.bounds(chunk.id, min, max);
+        float magnification = 0;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            float x = corner & 1 ? max.x() : min.x();
+            float y = corner & 2 ? max.y() : min.y();
+            float z = corner & 4 ? max.z() : min.z();
+            float w = m[3] * x + m[7] * y + m[11] * z + m[15];
+            magnification = w > 0 ? std::max(magnification, 1 / w) : std::numeric_limits<float>::infinity();
+            if (w <= 0)
+                break;
+        }
+
+        for (int level = meshes->chunk_tree.maxLevel(chunk); level > 0; level--)
+        {
+            if (meshes->chunk_tree.levelError(chunk.id, level) * units * magnification <= frame.lod_tolerance)
+            {
+                chunk.level = level;
+                break;
+            }
+        }
+        buffers.chunk_level[chunk.id] = chunk.level;
+    }
+}
+void Renderer::buildChunkFaces(const HeightfieldMesh &mesh)
+{
+    // Chunks not drawn count as level 0, their sides need no stitching
+    int chunks_x = meshes->chunk_tree.chunksPerRow(), chunks_y = meshes->chunk_tree.chunksPerColumn();
+    auto neighbourStep = [&](int id, int dx, int dy)
+    {
+        int x = id % chunks_x + dx, y = id / chunks_x + dy;
+        if (x < 0 || y < 0 || x >= chunks_x || y >= chunks_y)
+            return 1;
+        return 1 << buffers.chunk_level[y * chunks_x + x];
+    };
+
+    buffers.faces.clear();
+    for (TerrainChunk &chunk : buffers.chunks)
+    {
+        int side_steps[4];
+        side_steps[HeightfieldMesh::TOP] = neighbourStep(chunk.id, 0, -1);
+        side_steps[HeightfieldMesh::RIGHT] = neighbourStep(chunk.id, 1, 0);
+        side_steps[HeightfieldMesh::BOTTOM] = neighbourStep(chunk.id, 0, 1);
+        side_steps[HeightfieldMesh::LEFT] = neighbourStep(chunk.id, -1, 0);
+
+        chunk.first_face = buffers.faces.size();
+        mesh.blockTriangles(chunk.first_row, chunk.last_row, chunk.first_col, chunk.last_col, chunk.step(),
+                            side_steps, buffers.faces);
+        chunk.face_count = buffers.faces.size() - chunk.first_face;
+        frame_stats.faces_simplified += chunk.triangleCount() - chunk.face_count;
+    }
+}
+void Renderer::boundChunks(const HeightfieldMesh &mesh)
+{
+    for (TerrainChunk &chunk : buffers.chunks)
+    {
+        chunk.min_x = chunk.min_y = std::numeric_limits<float>::max();
+        chunk.max_x = chunk.max_y = chunk.max_z = -std::numeric_limits<float>::max();
+        int step = chunk.step();
+        for (int row = chunk.first_row; row <= chunk.last_row; row += step)
+        {
+            for (unsigned i = mesh.index(row, chunk.first_col); i <= mesh.index(row, chunk.last_col); i += step)
+            {
+                chunk.min_x = std::min(chunk.min_x, buffers.x[i]);
+                chunk.max_x = std::max(chunk.max_x, buffers.x[i]);
+                chunk.min_y = std::min(chunk.min_y, buffers.y[i]);
+                chunk.max_y = std::max(chunk.max_y, buffers.y[i]);
+                chunk.max_z = std::max(chunk.max_z, buffers.z[i]);
+            }
+        }
+    }
+}
+void Renderer::sortChunks()
+{
+    stage_keys.sorted = true;
+    // Larger depth is closer. Ties by id, so that resorting the chunks of the
+    // frame before gives the order sorting them as culled does.
+    std::sort(buffers.chunks.begin(), buffers.chunks.end(), [](const TerrainChunk &a, const TerrainChunk &b)
+              { return a.max_z > b.max_z || (a.max_z == b.max_z && a.id < b.id); });
+}
+void Renderer::drawChunks(const HeightfieldMesh *mesh, ColoringType coloring)
+{
+    std::vector<TerrainChunk> &chunks = buffers.chunks;
+    bool occlusion = coloring != WIREFRAME && frame.occlusion_culling;
+
+    auto isOccluded = [&](const TerrainChunk &chunk)
+    {
+        if (!occlusion || !isChunkOccluded(chunk))
+            return false;
+        frame_stats.chunks_occluded++;
+        frame_stats.faces_occluded += chunk.face_count;
+        return true;
+    };
+    bool culling = frame.backface_culling && coloring != WIREFRAME; // wireframes have no face normals
+    auto appendFaces = [&](const TerrainChunk &chunk, std::vector<uint32_t> &faces)
+    {
+        frame_stats.chunks_drawn++;
+        for (size_t f = chunk.first_face; f < chunk.first_face + chunk.face_count; f++)
+        {
+            const GridTriangle &face = buffers.faces[f];
+            if (culling && isBackFacing(chunkFaceNormal(*mesh, chunk, face).object, mesh->position(face.a), coloring))
+                frame_stats.faces_backfacing++;
+            else
+                faces.push_back((uint32_t)f);
+        }
+    };
+
+    std::vector<uint32_t> &faces = buffers.triangles;
+    if (coloring != WIREFRAME && frame.rasterizationAlgorithm == EDGE_FUNCTION)
+    {
+        // The tiled rasterizer draws the chunks in batches, the Hi-Z is refreshed between them
+        auto setup = [&](size_t i, RasterVertex v[3]) { setRasterTriangle(faces[i], coloring, v); };
+        size_t batch = std::max<size_t>(1, occlusion ? (chunks.size() + OCCLUSION_BATCHES - 1) / OCCLUSION_BATCHES
+                                                     : chunks.size());
+        for (size_t first = 0; first < chunks.size(); first += batch)
+        {
+            faces.clear();
+            float min_x = std::numeric_limits<float>::max(), min_y = min_x;
+            float max_x = -min_x, max_y = -min_x;
+            for (size_t c = first; c < std::min(first + batch, chunks.size()); c++)
+            {
+                const TerrainChunk &chunk = chunks[c];
+                if (isOccluded(chunk))
+                    continue;
+                appendFaces(chunk, faces);
+                min_x = std::min(min_x, chunk.min_x);
+                min_y = std::min(min_y, chunk.min_y);
+                max_x = std::max(max_x, chunk.max_x);
+                max_y = std::max(max_y, chunk.max_y);
+            }
+            frame_stats.faces_drawn += faces.size();
+            if (faces.empty())
+                continue;
+            frame_stats.pixels_drawn += tiled_rasterizer.draw(rasterTarget(), faces.size(), setup);
+            if (occlusion)
+                updateDepthPyramid(min_x, min_y, max_x, max_y);
+        }
+        return;
+    }
+
+    std::array<Vertex, 3> triangle;
+    for (const TerrainChunk &chunk : chunks)
+    {
+        if (isOccluded(chunk))
+            continue;
+
+        faces.clear();
+        appendFaces(chunk, faces);
+        frame_stats.faces_drawn += faces.size();
+        for (uint32_t f : faces)
+        {
+            const GridTriangle &face = buffers.faces[f];
+            setScreenVertex(triangle[0], face.a, coloring, f);
+            setScreenVertex(triangle[1], face.b, coloring, f);
+            setScreenVertex(triangle[2], face.c, coloring, f);
+            drawTriangle(triangle, coloring);
+        }
+        if (occlusion)
+            updateDepthPyramid(chunk.min_x, chunk.min_y, chunk.max_x, chunk.max_y);
+    }
+}
+bool Renderer::isChunkOccluded(const TerrainChunk &chunk)
+{
+    return depth_pyramid.occluded(chunk.min_x, chunk.min_y, chunk.max_x, chunk.max_y, chunk.max_z);
+}
+void Renderer::updateDepthPyramid(float min_x, float min_y, float max_x, float max_y)
+{
+    // Pixels the chunks may have covered, unbounded (NaN) sides extend to the image border
+    auto lower = [](float value, int border) { return value > border ? (int)value : border; };
+    auto upper = [](float value, int border) { return value < border ? (int)value : border; };
+    depth_pyramid.update(depth_buffer, lower(min_x - 1, 0), lower(min_y - 1, 0),
+                         upper(max_x + 2, img.width()), upper(max_y + 2, img.height()));
+}
+
+// Streamed terrain
+static int snapWindow(double start, int max_start)
+{
+    // Whole chunks, so that small moves of the view keep the window where it is
+    int snapped = (int)std::lround(start / Renderer::CHUNK_CELLS) * Renderer::CHUNK_CELLS;
+    return std::max(0, std::min(snapped, max_start));
+}
+void Renderer::updateTerrainWindow()
+{
+    const TilePyramid &pyramid = streamer->pyramid();
+    const TilePyramidHeader &info = pyramid.info();
+    int cells = pyramid.tileCells();
+
+    // Middle of the screen and how far around it may be seen, in full resolution samples
+    QVector3D focus = frame.camera.position / frame.object_scale / stream_scale + stream_center;
+    QPointF focus_sample((focus.x() - info.origin_x) / info.spacing_x, (focus.y() - info.origin_y) / info.spacing_y);
+    double sample_pixels = frame.object_scale * stream_scale * std::min(std::fabs(info.spacing_x), std::fabs(info.spacing_y));
+    double radius = 0.75 * std::hypot(img.width(), img.height()) / sample_pixels;
+
+    // Finest level at which the window reaches that far or holds the whole terrain
+    int level = 0;
+    while (level < pyramid.levels() - 1 && (double)((STREAM_WINDOW - 1) << level) < 2 * radius &&
+           (pyramid.levelRows(level) > STREAM_WINDOW || pyramid.levelCols(level) > STREAM_WINDOW))
+        level++;
+    int level_rows = pyramid.levelRows(level), level_cols = pyramid.levelCols(level);
+    int rows = std::min(STREAM_WINDOW, level_rows);
+    int cols = std::min(STREAM_WINDOW, level_cols);
+    int row = snapWindow(focus_sample.y() / (1 << level) - (rows - 1) / 2.0, level_rows - rows);
+    int col = snapWindow(focus_sample.x() / (1 << level) - (cols - 1) / 2.0, level_cols - cols);
+
+    QPointF moved = focus_sample - window.focus;
+    double distance = std::hypot(moved.x(), moved.y());
+    if (window.level >= 0 && distance > 0)
+        window.direction = moved / distance;
+    window.focus = focus_sample;
+
+    // Tiles of the window nearest to the focus first, then those the window needs
+    // after moving half its size on in the direction the view last moved
+    std::vector<TileKey> wanted;
+    auto addTiles = [&](int first_row, int first_col) {
+        std::vector<std::pair<double, TileKey>> tiles;
+        for (int y = first_row / cells; y <= std::min((first_row + rows - 2) / cells, pyramid.tilesY(level) - 1); y++)
+        {
+            for (int x = first_col / cells; x <= std::min((first_col + cols - 2) / cells, pyramid.tilesX(level) - 1); x++)
+            {
+                TileKey key = {level, x, y};
+                if (std::find(wanted.begin(), wanted.end(), key) != wanted.end())
+                    continue;
+                double dx = (x + 0.5) * (cells << level) - focus_sample.x();
+                double dy = (y + 0.5) * (cells << level) - focus_sample.y();
+                tiles.push_back({dx * dx + dy * dy, key});
+            }
+        }
+        std::sort(tiles.begin(), tiles.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+        for (const auto &tile : tiles)
+            wanted.push_back(tile.second);
+    };
+    addTiles(row, col);
+    if (!window.direction.isNull())
+    {
+        double shift = (STREAM_WINDOW - 1) / 2.0;
+        addTiles(std::max(0, std::min((int)std::lround(row + window.direction.y() * shift), level_rows - rows)),
+                 std::max(0, std::min((int)std::lround(col + window.direction.x() * shift), level_cols - cols)));
+    }
+
+    // No more than fit the budget next to the root tile, or they would evict each other forever
+    size_t capacity = streamer->stats().budget_bytes / (pyramid.tileSamples() * sizeof(float));
+    if (wanted.size() + 1 > capacity)
+        wanted.resize(capacity - 1);
+    streamer->request(wanted);
+
+    // Refilled when it moves, or when tiles it lacked may have arrived
+    uint64_t generation = streamer->generation();
+    bool moved_window = level != window.level || row != window.row || col != window.col ||
+                        rows != meshes->grid.rows || cols != meshes->grid.cols;
+    if (moved_window || (!window.complete && generation != window.generation))
+    {
+        window.generation = generation;
+        fillTerrainWindow(level, row, col, rows, cols);
+        meshes->chunk_tree.build(meshes->grid, CHUNK_CELLS);
+        meshes->geometry = meshes->colors = RenderMeshes::nextVersion();
+    }
+}
+void Renderer::fillTerrainWindow(int level, int row, int col, int rows, int cols)
+{
+    const TilePyramid &pyramid = streamer->pyramid();
+    const TilePyramidHeader &info = pyramid.info();
+    int cells = pyramid.tileCells();
+    int top = pyramid.levels() - 1;
+
+    HeightfieldMesh &grid = meshes->grid;
+    if (grid.rows != rows || grid.cols != cols)
+        grid.resize(rows, cols);
+    normals.invalidate();
+    window.level = level;
+    window.row = row;
+    window.col = col;
+    window.complete = true;
+
+    // Where a sample of level lies between two samples of a tile of a coarser level
+    struct Sample
+    {
+        int first, second; // in the tile
+        float t;
+    };
+    auto locate = [&](int full, int tile_level, int tile_first, int level_samples, int full_samples) {
+        int k = std::min(full >> tile_level, level_samples - 1);
+        int next = std::min(k + 1, level_samples - 1);
+        int base = std::min(k << tile_level, full_samples - 1);
+        int end = std::min(next << tile_level, full_samples - 1);
+        Sample sample = {k - tile_first, std::min(next - tile_first, cells), end > base ? float(full - base) / (end - base) : 0.f};
+        return sample;
+    };
+
+    int last_y = std::min((row + rows - 2) / cells, pyramid.tilesY(level) - 1);
+    int last_x = std::min((col + cols - 2) / cells, pyramid.tilesX(level) - 1);
+    std::vector<Sample> row_samples, col_samples;
+    for (int tile_y = row / cells; tile_y <= last_y; tile_y++)
+    {
+        // Window rows of this tile, the border row belongs to the next tile
+        int first_row = std::max(row, tile_y * cells);
+        int end_row = tile_y == last_y ? row + rows : (tile_y + 1) * cells;
+        for (int tile_x = col / cells; tile_x <= last_x; tile_x++)
+        {
+            int first_col = std::max(col, tile_x * cells);
+            int end_col = tile_x == last_x ? col + cols : (tile_x + 1) * cells;
+
+            // The tile or the nearest coarser one containing it, the coarsest is always there
+            int tile_level = level, x = tile_x, y = tile_y;
+            std::shared_ptr<const TerrainTile> tile = streamer->find({tile_level, x, y});
+            while (!tile && tile_level < top)
+            {
+                tile_level++;
+                x >>= 1;
+                y >>= 1;
+                tile = streamer->find({tile_level, x, y});
+            }
+            if (!tile)
+                continue;
+            window.complete &= tile_level == level;
+
+            row_samples.clear();
+            for (int s = first_row; s < end_row; s++)
+                row_samples.push_back(locate(pyramid.fullRow(level, s), tile_level, tile->key.y * cells, pyramid.levelRows(tile_level), info.rows));
+            col_samples.clear();
+            for (int s = first_col; s < end_col; s++)
+                col_samples.push_back(locate(pyramid.fullCol(level, s), tile_level, tile->key.x * cells, pyramid.levelCols(tile_level), info.cols));
+
+            const float *heights = tile->heights.data();
+            for (int i = 0; i < end_row - first_row; i++)
+            {
+                const Sample &r = row_samples[i];
+                const float *upper = heights + (size_t)r.first * (cells + 1);
+                const float *lower = heights + (size_t)r.second * (cells + 1);
+                float y = (info.origin_y + pyramid.fullRow(level, first_row + i) * info.spacing_y - stream_center.y()) * stream_scale;
+                for (int j = 0; j < end_col - first_col; j++)
+                {
+                    const Sample &c = col_samples[j];
+                    float near_row = upper[c.first] + (upper[c.second] - upper[c.first]) * c.t;
+                    float far_row = lower[c.first] + (lower[c.second] - lower[c.first]) * c.t;
+                    float height = near_row + (far_row - near_row) * r.t;
+
+                    unsigned v = grid.index(first_row + i - row, first_col + j - col);
+                    grid.x[v] = (info.origin_x + pyramid.fullCol(level, first_col + j) * info.spacing_x - stream_center.x()) * stream_scale;
+                    grid.y[v] = y;
+                    grid.z[v] = (height - stream_center.z()) * stream_scale_z;
+                    QColor color = heightColor((height - info.min_z) / (info.max_z - info.min_z));
+                    grid.color[v] = color.isValid() ? color.rgb() : frame.globalColor.rgb();
+                }
+            }
+        }
+    }
+}
+
+// Shared by both meshes
+Lighting Renderer::prepareLighting(const QMatrix4x4 &view, const LightSource &light) const
+{
+    const LightModel &lightModel = frame.lightModel;
+    QMatrix4x4 inverse_view = view.inverted();
+
+    Lighting lighting;
+    lighting.light_position = inverse_view.map(light.position);
+    lighting.eye = inverse_view.map(QVector3D(0, 0, 400));
+    lighting.ambient = lightModel.ambient;
+    lighting.diffuse = QVector3D(light.color.red() * lightModel.diffuse.x() / 255.,
+                                 light.color.green() * lightModel.diffuse.y() / 255.,
+                                 light.color.blue() * lightModel.diffuse.z() / 255.);
+    lighting.specular = QVector3D(light.color.red() * lightModel.specular.x() / 255.,
+                                  light.color.green() * lightModel.specular.y() / 255.,
+                                  light.color.blue() * lightModel.specular.z() / 255.);
+    lighting.intensity = light.intensity;
+    lighting.specular_sharpness = lightModel.specular_sharpness;
+    return lighting;
+}
+QRgb Renderer::shade(QVector3D point, QVector3D normal, QRgb color, const Lighting &lighting)
+{
+    QVector3D ligh_v = (lighting.light_position - point).normalized();
+    QVector3D refl_v = 2 * QVector3D::dotProduct(normal, ligh_v) * normal - ligh_v;
+    QVector3D view_v = (lighting.eye - point).normalized();
+
+    QVector3D Ia, Id, Im;
+
+    // Ambient
+    Ia = QVector3D(qRed(color) * lighting.ambient.x() / 255.,
+                   qGreen(color) * lighting.ambient.y() / 255.,
+                   qBlue(color) * lighting.ambient.z() / 255.);
+
+    // Diffuse
+    float diffuse = QVector3D::dotProduct(normal, ligh_v) * lighting.intensity / 100.;
+    if (diffuse > 0)
+        Id = diffuse * lighting.diffuse;
+
+    // Mirror
+    float mirror = QVector3D::dotProduct(refl_v, view_v) * lighting.intensity / 255.;
+    if (mirror > 0)
+        Im = pow(mirror, lighting.specular_sharpness) * lighting.specular;
+
+    QVector3D final_light = Ia + Id + Im;
+    if (final_light.x() > 1)
+        final_light.setX(1);
+    if (final_light.y() > 1)
+        final_light.setY(1);
+    if (final_light.z() > 1)
+        final_light.setZ(1);
+    return qRgb(final_light.x() * 255, final_light.y() * 255, final_light.z() * 255);
+}
+void Renderer::setScreenVertex(Vertex &vertex, unsigned int i, ColoringType coloring, size_t face)
+{
+    vertex.x = buffers.x[i];
+    vertex.y = buffers.y[i];
+    vertex.z = buffers.z[i];
+    if (coloring == WIREFRAME)
+        vertex.color = frame.globalColor.rgb();
+    else if (coloring == SIDE)
+        vertex.color = buffers.face_color[face];
+    else
+        vertex.color = buffers.color[i];
+}
+void Renderer::drawTriangle(const std::array<Vertex, 3> &triangle, ColoringType coloring)
+{
+    if (coloring == WIREFRAME)
+    {
+        drawLine(triangle[0], triangle[1]);
+        drawLine(triangle[1], triangle[2]);
+        drawLine(triangle[2], triangle[0]);
+    }
+    else if (frame.rasterizationAlgorithm == EDGE_FUNCTION)
+    {
+        rasterizeTriangle(triangle);
+    }
+    else if (coloring == SIDE || coloring == VERTEX)
+    {
+        fillTriangle(triangle);
+    }
+}
+
+//// Clipping ////
+
+// Cyrus-Beck
+void Renderer::clipLine(Vertex start, Vertex end, Vertex &clip_start, Vertex &clip_end)
+{
+    if (!isInside(start) && !isInside(end))
+    {
+        clip_start = Vertex();
+        clip_end = Vertex();
+        return;
+    }
+    if (isInside(start) && isInside(end))
+    {
+        clip_start = start;
+        clip_end = end;
+        return;
+    }
+
+    double tl = 0, tu = 1;
+    QVector3D d = end.toVector3D() - start.toVector3D();
+
+    const QPoint E[4] = {QPoint(10, 10), QPoint(10, img.height() - 10), QPoint(img.width() - 10, img.height() - 10), QPoint(img.width() - 10, 10)};
+
+    for (int i = 0; i < 4; i++)
+    {
+        QPoint n = E[(i + 1) % 4] - E[i];
+        n = QPoint(n.y(), -n.x());
+        QPoint w = start.toPoint() - E[i];
+        double dn = QPoint::dotProduct(n, d.toPoint());
+        double wn = QPoint::dotProduct(n, w);
+        if (dn != 0)
+        {
+            double t = -wn / dn;
+            if (dn > 0 && t <= 1)
+            {
+                if (tl < t)
+                    tl = t;
+            }
+            else if (dn < 0 && 0 <= t)
+            {
+                if (tu > t)
+                    tu = t;
+            }
+        }
+    }
+
+    if (tl == 0 && tu == 1)
+    {
+        clip_start = start;
+        clip_end = end;
+    }
+    else if (tl < tu)
+    {
+        clip_start = start.interpolate(end, tl);
+        clip_end = start.interpolate(end, tu);
+        // clip_start = start + d * tl;
+        // clip_end = start + d * tu;
+    }
+    // printf("clip_start: %d %d", clip_start.x(), clip_start.y());
+    // printf("clip_end: %d %d", clip_end.x(), clip_end.y());
+}
+
+// Sutherland-Hodgman
+void Renderer::clipPolygonLeftSide(std::list<Vertex> &polygon, int x_min)
+{
+
+    if (polygon.size() == 0)
+        return;
+
+    std::list<Vertex> result;
+
+    Vertex last_vertex = polygon.back();
+
+    for (Vertex vertex : polygon)
+    {
+        if (vertex.x >= x_min)
+        {
+            if (last_vertex.x >= x_min)
+            {
+                result.push_back(vertex);
+            }
+            else
+            {
+                Vertex new_vertex = last_vertex.interpolate(vertex, (x_min - last_vertex.x) / (vertex.x - last_vertex.x));
+                new_vertex.x = x_min;
+                // QVector3D new_vertex(
+                //     x_min,
+                //     last_vertex.y + (x_min - last_vertex.x) * (vertex.y - last_vertex.y) / (vertex.x - last_vertex.x),
+                //     last_vertex.z + (x_min - last_vertex.x) * (vertex.z - last_vertex.z) / (vertex.x - last_vertex.x));
+                result.push_back(new_vertex);
+                result.push_back(vertex);
+            }
+        }
+        else
+        {
+            if (last_vertex.x >= x_min)
+            {
+                Vertex new_vertex = last_vertex.interpolate(vertex, (x_min - last_vertex.x) / (vertex.x - last_vertex.x));
+                new_vertex.x = x_min;
+
+                // QVector3D new_vertex(
+                //     x_min,
+                //     last_vertex.y + (x_min - last_vertex.x) * (vertex.y - last_vertex.y) / (vertex.x - last_vertex.x),
+                //     last_vertex.z + (x_min - last_vertex.x) * (vertex.z - last_vertex.z) / (vertex.x - last_vertex.x));
+                result.push_back(new_vertex);
+            }
+        }
+        last_vertex = vertex;
+    }
+    polygon = result;
+    return;
+}
+void Renderer::clipPolygon(std::list<Vertex> &polygon)
+{
+    if (!isPolygonInside(polygon))
+    {
+        polygon.clear();
+        return;
+    }
+
+    QPoint E[4] = {QPoint(10, 10), QPoint(img.width() - 10, 10), QPoint(img.width() - 10, img.height() - 10), QPoint(10, img.height() - 10)};
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (polygon.size() == 0)
+            return;
+
+        clipPolygonLeftSide(polygon, E[i].x());
+
+        for (std::list<Vertex>::iterator it = polygon.begin(); it != polygon.end(); it++)
+        {
+            // *it = Vertex(it->y, -it->x, it->z);
+            double tmp = it->x;
+            it->x = it->y;
+            it->y = -tmp;
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            E[i] = QPoint(E[i].y(), -E[i].x());
+        }
+    }
+}
+
+void Renderer::clearBuffers()
+{
+    img.fill(Qt::white);
+    stage_keys.image = false;
+    setDataPtr(); // copies of the last frame may share img until now
+    depth_buffer.clear();
+    depth_pyramid.clear();
+}
+
+//// FRAMES ////
+
+void Renderer::beginFrame(const SceneState &scene)
+{
+    frame = scene;
+    frame_stats = CullingStats();
+    if (!isEmpty())
+        clearBuffers();
+}
+bool Renderer::render(const SceneState &scene)
+{
+    frame_profiler.beginFrame();
+    if (!stage_caching)
+        invalidateStages();
+
+    // The window of a streamed terrain follows the camera, refilling it changes the geometry
+    if (streamer && scene.draw_object && !isEmpty())
+    {
+        ProfileScope scope(frame_profiler, FrameProfiler::STREAM);
+        frame = scene;
+        updateTerrainWindow();
+    }
+
+    // Nothing changed since the frame in the image, it and its stats are kept
+    if (isFrameKept(scene))
+    {
+        for (FrameProfiler::Stage stage : {FrameProfiler::CLEAR, FrameProfiler::CULL, FrameProfiler::TRANSFORM,
+                                           FrameProfiler::NORMALS, FrameProfiler::SHADE, FrameProfiler::RASTERIZE})
+            frame_profiler.cacheHit(stage);
+        frame_profiler.endFrame(frame_stats.faces_drawn, frame_stats.pixels_drawn);
+        return false;
+    }
+
+    {
+        ProfileScope scope(frame_profiler, FrameProfiler::CLEAR);
+        beginFrame(scene);
+    }
+    if (isEmpty() || !frame.draw_object)
+        return true;
+
+    drawObject();
+    frame_profiler.endFrame(frame_stats.faces_drawn, frame_stats.pixels_drawn);
+    if (hud)
+    {
+        drawHud();
+        return true; // the image is no frame to keep
+    }
+    stage_keys.image = true;
+    stage_keys.scene = scene;
+    stage_keys.image_geometry = meshes->geometry;
+    stage_keys.image_colors = meshes->colors;
+    return true;
+}
+void Renderer::setStageCaching(bool enable)
+{
+    stage_caching = enable;
+    invalidateStages();
+}
+
+// Stage keys
+static bool sameScene(const Renderer::SceneState &a, const Renderer::SceneState &b)
+{
+    const Camera &ca = a.camera, &cb = b.camera;
+    const LightSource &la = a.lightSource, &lb = b.lightSource;
+    const LightModel &ma = a.lightModel, &mb = b.lightModel;
+    return a.globalColor == b.globalColor && a.rasterizationAlgorithm == b.rasterizationAlgorithm &&
+           a.coloringType == b.coloringType && a.object_scale == b.object_scale && a.z_scale == b.z_scale &&
+           ca.position == cb.position && ca.zenit == cb.zenit && ca.azimuth == cb.azimuth &&
+           ca.center_of_projection == cb.center_of_projection &&
+           la.position == lb.position && la.color == lb.color && la.intensity == lb.intensity &&
+           ma.ambient_color == mb.ambient_color && ma.ambient == mb.ambient && ma.diffuse == mb.diffuse &&
+           ma.specular == mb.specular && ma.specular_sharpness == mb.specular_sharpness &&
+           a.draw_object == b.draw_object && a.occlusion_culling == b.occlusion_culling &&
+           a.backface_culling == b.backface_culling && a.lod_tolerance == b.lod_tolerance;
+}
+static bool sameLighting(const Lighting &a, const Lighting &b)
+{
+    return a.light_position == b.light_position && a.eye == b.eye && a.ambient == b.ambient &&
+           a.diffuse == b.diffuse && a.specular == b.specular && a.intensity == b.intensity &&
+           a.specular_sharpness == b.specular_sharpness;
+}
+// Version of a mesh of the renderer, 0 for other meshes
+uint64_t Renderer::meshVersion(const void *mesh) const
+{
+    return mesh == &meshes->grid || mesh == &meshes->object ? meshes->geometry : 0;
+}
+bool Renderer::isTransformKept(const void *mesh, const QMatrix4x4 &transform)
+{
+    const StageKeys &keys = stage_keys;
+    uint64_t geometry = meshVersion(mesh);
+    if (geometry == 0 || keys.transformed == 0 || keys.mesh != mesh || keys.geometry != geometry ||
+        keys.transform != transform || keys.image_size != img.size() || keys.lod_tolerance != frame.lod_tolerance)
+        return false;
+
+    frame_stats.chunks_outside = keys.culling.chunks_outside;
+    frame_stats.faces_outside = keys.culling.faces_outside;
+    frame_stats.faces_simplified = keys.culling.faces_simplified;
+    frame_profiler.cacheHit(FrameProfiler::CULL);
+    frame_profiler.cacheHit(FrameProfiler::TRANSFORM);
+    return true;
+}
+void Renderer::keepTransform(const void *mesh, const QMatrix4x4 &transform)
+{
+    StageKeys &keys = stage_keys;
+    keys.mesh = mesh;
+    keys.geometry = meshVersion(mesh);
+    keys.transform = transform;
+    keys.image_size = img.size();
+    keys.lod_tolerance = frame.lod_tolerance;
+    keys.culling = frame_stats;
+    keys.transformed = ++keys.counter;
+    keys.sorted = false;
+}
+bool Renderer::isShadingKept(ColoringType coloring, const Lighting &lighting)
+{
+    const StageKeys &keys = stage_keys;
+    if (keys.shaded == 0 || keys.shaded != keys.transformed || keys.coloring != coloring ||
+        keys.colors != meshes->colors || !sameLighting(keys.lighting, lighting))
+        return false;
+
+    frame_profiler.cacheHit(FrameProfiler::SHADE);
+    return true;
+}
+void Renderer::keepShading(ColoringType coloring, const Lighting &lighting)
+{
+    StageKeys &keys = stage_keys;
+    keys.shaded = keys.transformed;
+    keys.coloring = coloring;
+    keys.colors = meshes->colors;
+    keys.lighting = lighting;
+}
+bool Renderer::isFrameKept(const SceneState &scene) const
+{
+    const StageKeys &keys = stage_keys;
+    return keys.image && !hud && !isEmpty() && keys.image_geometry == meshes->geometry &&
+           keys.image_colors == meshes->colors && sameScene(keys.scene, scene);
+}
+void Renderer::setHudVisible(bool visible)
+{
+    hud = visible;
+    frame_profiler.setEnabled(visible);
+}
+void Renderer::drawHud()
+{
+    QStringList lines;
+    FrameProfiler::Percentiles total = frame_profiler.percentiles(FrameProfiler::FRAME);
+    lines << QString("frame %1 ms, p50 %2  p95 %3  p99 %4")
+                 .arg(frame_profiler.lastTime(FrameProfiler::FRAME), 0, 'f', 1)
+                 .arg(total.p50, 0, 'f', 1)
+                 .arg(total.p95, 0, 'f', 1)
+                 .arg(total.p99, 0, 'f', 1);
+    lines << QString("triangles %1  pixels %2").arg(frame_profiler.lastTriangles()).arg(frame_profiler.lastPixels());
+    lines << QString("%1 %2 %3 %4 %5 %6").arg("ms", -10).arg("last", 7).arg("p50", 7).arg("p95", 7).arg("p99", 7).arg("cached", 7);
+    for (int stage = FrameProfiler::CLEAR; stage < FrameProfiler::STAGE_COUNT; stage++)
+    {
+        FrameProfiler::Stage s = (FrameProfiler::Stage)stage;
+        FrameProfiler::Percentiles times = frame_profiler.percentiles(s);
+        lines << QString("%1 %2 %3 %4 %5 %6")
+                     .arg(FrameProfiler::stageName(s), -10)
+                     .arg(frame_profiler.lastTime(s), 7, 'f', 2)
+                     .arg(times.p50, 7, 'f', 2)
+                     .arg(times.p95, 7, 'f', 2)
+                     .arg(times.p99, 7, 'f', 2)
+                     .arg(QString::number(100 * frame_profiler.cacheHitRate(s), 'f', 0) + "%", 7);
+    }
+
+    QPainter painter(&img);
+    QFont font("monospace");
+    font.setStyleHint(QFont::TypeWriter);
+    font.setPixelSize(12);
+    painter.setFont(font);
+    QFontMetrics metrics(font);
+    int width = 0;
+    for (const QString &line : lines)
+        width = std::max(width, metrics.horizontalAdvance(line));
+    painter.fillRect(QRect(0, 0, width + 12, lines.size() * metrics.lineSpacing() + 8), QColor(0, 0, 0, 160));
+    painter.setPen(Qt::white);
+    for (int i = 0; i < lines.size(); i++)
+        painter.drawText(6, 4 + metrics.ascent() + i * metrics.lineSpacing(), lines[i]);
+}
+void Renderer::resizeBuffers()
+{
+    depth_buffer.resize(img.width(), img.height());
+    depth_pyramid.resize(10, 10, img.width() - 10, img.height() - 10); // area of isInside()
+}
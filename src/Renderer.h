@@ -0,0 +1,445 @@
+#pragma once
+#include <QtGui>
+
+#include <float.h>
+#include <memory>
+#include "ObjectRepresentation.h"
+#include "HeightfieldMesh.h"
+#include "VertexTransform.h"
+#include "DepthBuffer.h"
+#include "DepthPyramid.h"
+#include "FrameProfiler.h"
+#include "ChunkQuadtree.h"
+#include "TerrainStreamer.h"
+#include "TriangleRasterizer.h"
+#include "TiledRasterizer.h"
+
+struct Camera
+{
+    QVector3D position;
+    double zenit;
+    double azimuth;
+    double center_of_projection;
+};
+
+struct LightSource
+{
+    QVector3D position;
+    QColor color;
+    int intensity;
+};
+
+struct LightModel
+{
+    QColor ambient_color;
+    QVector3D ambient;
+    QVector3D diffuse;
+    QVector3D specular;
+    double specular_sharpness;
+};
+
+// Light source and light model of one frame, premultiplied for shade().
+// Positions are in world coordinates, colors are RGB factors in <0, 1>.
+struct Lighting
+{
+    QVector3D light_position;
+    QVector3D eye;
+    QVector3D ambient;  // share of the surface color
+    QVector3D diffuse;  // light color * diffuse coefficients
+    QVector3D specular; // light color * specular coefficients
+    int intensity;
+    double specular_sharpness;
+};
+
+// Chunks and faces drawn and skipped in one frame. Heightfield faces are its
+// triangles, chunks exist only for heightfields.
+struct CullingStats
+{
+    size_t chunks_drawn = 0;
+    size_t chunks_occluded = 0; // hidden behind nearer terrain (Hi-Z)
+    size_t chunks_outside = 0;  // outside the view frustum
+    size_t faces_drawn = 0;
+    size_t faces_occluded = 0;
+    size_t faces_outside = 0;
+    size_t faces_backfacing = 0;
+    size_t faces_simplified = 0; // full resolution triangles left out by the level of detail
+    size_t pixels_drawn = 0;     // rasterized, including those failing the depth test
+};
+
+// Per-frame working arrays indexed like the mesh vertices and faces. They are
+// kept between frames, so redrawing an unchanged mesh does not allocate.
+struct RenderBuffers
+{
+    std::vector<float> x, y, z;            // vertices in screen coordinates
+    std::vector<QRgb> color;               // shaded vertex colors
+    std::vector<QRgb> face_color;          // shaded face colors
+    std::vector<TerrainChunk> chunks;      // visible heightfield chunks
+    std::vector<uint8_t> chunk_level;      // by chunk id, 0 for chunks not drawn
+    std::vector<GridTriangle> faces;       // heightfield triangles of the visible chunks
+    std::vector<uint32_t> triangles;       // faces to draw from one batch of chunks
+    std::vector<uint32_t> shaded_frame;    // frame a vertex color was last computed in
+    uint32_t frame = 0;
+
+    uint32_t nextFrame()
+    {
+        if (++frame == 0)
+        {
+            std::fill(shaded_frame.begin(), shaded_frame.end(), 0);
+            frame = 1;
+        }
+        return frame;
+    }
+    void resize(size_t vertices, size_t faces)
+    {
+        shaded_frame.resize(vertices);
+        x.resize(vertices);
+        y.resize(vertices);
+        z.resize(vertices);
+        color.resize(vertices);
+        face_color.resize(faces);
+    }
+};
+
+// Unit normals of the mesh being drawn, pointing as in world coordinates.
+// The model matrix scales a normal in proportion to (z_scale, z_scale, 1),
+// zoom leaves its direction be, so they are kept until the geometry or the z
+// scale changes and moving the camera or the light computes none.
+// Heightfield vertex normals are computed chunk by chunk, when a chunk is
+// first drawn, and its face normals when it is first drawn at a level.
+struct MeshNormals
+{
+    struct Face
+    {
+        QVector3D world;  // unit normal, as face
+        QVector3D object; // as face_object
+    };
+
+    std::vector<QVector3D> vertex;      // by vertex index
+    std::vector<QVector3D> face;        // by face index, irregular meshes only
+    std::vector<QVector3D> face_object; // not normalized, in mesh coordinates, for back-face culling
+    std::vector<uint8_t> chunk_done;    // by heightfield chunk id
+    // Heightfield triangles by chunk id * ChunkQuadtree::levelCount() + level, then by
+    // 2 * (cell of the level, row-major within the chunk) + triangle; empty
+    // until the chunk is drawn at that level
+    std::vector<std::vector<Face>> chunk_faces;
+    const void *mesh = nullptr;         // the normals are of, nullptr when out of date
+    double z_scale = 1;
+
+    bool isValid(const void *of, double z) const { return mesh == of && z_scale == z; }
+    void invalidate() { mesh = nullptr; }
+};
+
+// Meshes a Renderer draws. They are only read while rendering, so renderers
+// drawing the same terrain may share them (see Renderer::shareMeshes()).
+struct RenderMeshes
+{
+    ThreeDObject object; // irregular meshes only
+    HeightfieldMesh grid;
+    ChunkQuadtree chunk_tree; // of grid, rebuilt when its geometry changes
+
+    // Changed whenever the vertices or the colors of the meshes change, unique
+    // among all meshes, so that renderers know when their results are stale
+    static uint64_t nextVersion();
+    uint64_t geometry = nextVersion();
+    uint64_t colors = nextVersion();
+};
+
+// The rendering pipeline: transformation, lighting, culling, rasterization and
+// the depth buffer, drawing into a plain ARGB32 image. It has no window and
+// no render thread of its own; render() draws one frame on the calling thread,
+// so the same pipeline serves the viewer window and headless rendering.
+class Renderer
+{
+public:
+    enum ColoringType
+    {
+        WIREFRAME,
+        SIDE,
+        VERTEX
+    };
+    enum RasterizationAlgorithm
+    {
+        DDA,
+        BRESENHAMM,
+        EDGE_FUNCTION // filled triangles only, lines are drawn with DDA
+    };
+
+    // Everything a frame is rendered from, apart from the meshes
+    struct SceneState
+    {
+        QColor globalColor;
+        RasterizationAlgorithm rasterizationAlgorithm = DDA;
+        ColoringType coloringType = WIREFRAME;
+        double object_scale = 1; // zoom, applied by the model matrix
+        double z_scale = 1;
+        Camera camera;
+        LightSource lightSource;
+        LightModel lightModel;
+        bool draw_object = true; // false for a cleared frame
+        bool occlusion_culling = true; // Hi-Z culling of filled heightfield chunks
+        bool backface_culling = true;
+        double lod_tolerance = 1; // largest screen error of simplified heightfield chunks, in pixels
+    };
+
+    static constexpr int CHUNK_CELLS = 16;      // heightfield chunk size in cells per side, a power of two
+    static constexpr int OCCLUSION_BATCHES = 8; // tiled draws per frame, the Hi-Z is updated after each
+    static constexpr int STREAM_WINDOW = 513;   // vertices per side of the grid drawn from a streamed terrain
+
+private:
+    QImage img; // framebuffer
+    uchar *data = nullptr;
+    DepthBuffer depth_buffer;   // sized like img
+    DepthPyramid depth_pyramid; // Hi-Z of depth_buffer over the drawing area
+    CullingStats frame_stats;   // of the last frame
+    FrameProfiler frame_profiler;
+    bool hud = false;           // profiler overlay drawn over the frame
+    SceneState frame;           // scene being rendered
+    QColor global_color;        // of loaded meshes, where the height gives none
+
+    // Object
+    std::shared_ptr<RenderMeshes> meshes = std::make_shared<RenderMeshes>();
+    RenderBuffers buffers;
+    MeshNormals normals;
+    QVector4D viewer; // center of projection in mesh coordinates, w = 0 for a direction
+    TiledRasterizer tiled_rasterizer; // filled heightfields with EDGE_FUNCTION
+
+    // What the render buffers and the image were computed from. render()
+    // redoes only the stages whose inputs changed: a new light shades and
+    // rasterizes again but neither culls nor transforms, an unchanged scene
+    // keeps the image. Meshes are told apart by their versions, 0 matches
+    // nothing; meshes not of the renderer are always drawn from scratch.
+    struct StageKeys
+    {
+        // Culling and transformation
+        const void *mesh = nullptr;
+        uint64_t geometry = 0;
+        QMatrix4x4 transform;
+        QSize image_size;
+        double lod_tolerance = 0;
+        CullingStats culling;     // counted by these stages, restored when they are skipped
+        uint64_t transformed = 0; // version of the screen vertices, 0 when out of date
+        bool sorted = false;      // chunks front to back, no longer as culled
+
+        // Shading
+        uint64_t shaded = 0; // version of the screen vertices the colors are for, 0 when out of date
+        uint64_t colors = 0;
+        ColoringType coloring = WIREFRAME;
+        Lighting lighting;
+
+        // The image
+        bool image = false; // the frame of scene is in img, or wherever swapImage() put it
+        SceneState scene;
+        uint64_t image_geometry = 0, image_colors = 0;
+
+        uint64_t counter = 0; // last version given out
+    };
+    StageKeys stage_keys;
+    bool stage_caching = true;
+
+    uint64_t meshVersion(const void *mesh) const;
+    bool isTransformKept(const void *mesh, const QMatrix4x4 &transform);
+    void keepTransform(const void *mesh, const QMatrix4x4 &transform);
+    bool isShadingKept(ColoringType coloring, const Lighting &lighting);
+    void keepShading(ColoringType coloring, const Lighting &lighting);
+    bool isFrameKept(const SceneState &scene) const;
+
+    // Out-of-core terrain. grid is then a window into one level of its tiles,
+    // placed around the middle of the screen by render(), which refills it
+    // when the view moves or missing tiles arrive.
+    struct TerrainWindow
+    {
+        int level = -1;
+        int row = 0, col = 0; // first sample of the level
+        bool complete = false; // no tile was replaced by a coarser one
+        uint64_t generation = 0; // of the streamer when filled
+        QPointF focus;          // middle of the screen in full resolution samples
+        QPointF direction;      // unit vector of its last move
+    };
+    std::shared_ptr<TerrainStreamer> streamer;
+    QVector3D stream_center; // of the whole terrain, in its own coordinates
+    double stream_scale = 1, stream_scale_z = 1;
+    TerrainWindow window;
+
+    void resizeBuffers();
+    void fitHeightfield();
+
+public:
+    Renderer(QSize size = QSize(0, 0));
+
+    // Image functions
+    void setImage(const QImage &image); // size and initial contents of the framebuffer
+    void resize(QSize size);            // white framebuffer of the given size
+    const QImage &image() const { return img; }
+    // Exchanges the framebuffer with other, of the same size and format (double
+    // buffering), after a frame was drawn. A frame render() keeps goes to other
+    // with it: for the same scene render() then leaves other be the frame.
+    void swapImage(QImage &other);
+    bool isEmpty() const { return img.isNull(); }
+
+    void setThreadCount(int threads) { tiled_rasterizer.setThreadCount(threads); }
+    int threadCount() const { return tiled_rasterizer.threadCount(); }
+
+    //// Frames ////
+    // Draws scene into the image. False when nothing changed since the frame
+    // before and it was kept, in the image or where swapImage() put it.
+    bool render(const SceneState &scene);
+    // Clears the image and the counters and takes the settings of scene, as
+    // render() does first; enough to draw single triangles
+    void beginFrame(const SceneState &scene);
+    const CullingStats &stats() const { return frame_stats; } // of the last frame
+
+    // Reuse of the stage results of the frame before (see StageKeys), on by
+    // default. Off, every frame is culled, transformed, shaded and rasterized
+    // as if the camera had moved; the normals are kept still.
+    void setStageCaching(bool enable);
+    bool stageCaching() const { return stage_caching; }
+    void invalidateStages() { stage_keys = StageKeys(); } // the next frame computes every stage
+
+    // Stage timing of render(), enabled by the overlay or by tracing
+    FrameProfiler &profiler() { return frame_profiler; }
+    void setHudVisible(bool visible);
+    bool isHudVisible() const { return hud; }
+    void drawHud(); // frame time, triangles and pixels of the last frame, percentiles and cache hits of the stages
+
+    // void setPixel(int x, int y, uchar r, uchar g, uchar b, uchar a = 255);
+    // void setPixel(int x, int y, double valR, double valG, double valB, double valA = 1.);
+    void setPixel(int x, int y, float z, QRgb color)
+    {
+        frame_stats.pixels_drawn++;
+        if (!depth_buffer.test(x, y, z))
+            return;
+        reinterpret_cast<QRgb *>(data + (size_t)y * img.bytesPerLine())[x] = color;
+    }
+    void setPixel(QVector3D point, QRgb color) { setPixel(point.x() + 0.5, point.y() + 0.5, point.z(), color); }
+    void setPixel(const Vertex &vertex) { setPixel(vertex.x, vertex.y, vertex.z, vertex.color); }
+    bool isInside(int x, int y) { return (x >= 10 && y >= 10 && x < img.width() - 10 && y < img.height() - 10) ? true : false; }
+    bool isInside(QPoint point) { return isInside(point.x(), point.y()); }
+    bool isInside(Vertex vertex) { return isInside(vertex.x, vertex.y); }
+    bool isPolygonInside(std::list<Vertex> polygon);
+
+    //// 3D Object ////
+    // The loaders fit the mesh to the image and color it by height
+    void setGlobalColor(QColor color); // recolors the loaded mesh
+    void debugObject(ThreeDObject &object);
+    void loadObject(const std::vector<QVector3D> &vertices, const std::vector<std::vector<unsigned int>> &polygons);
+    void loadHeightfield(const std::vector<QVector3D> &points, int rows, int cols);
+    // Regular grid, its vertex positions computed from the spacing
+    void loadHeightfield(const HeightGrid &heights);
+    void translateObject(QVector3D offset);
+    // Draws a terrain streamed from disk, nullptr stops streaming
+    void loadStreamedTerrain(std::shared_ptr<TerrainStreamer> terrain);
+    void stopStreaming();
+    // Draws the meshes of other without copying them; the two may then render
+    // at the same time. setGlobalColor() and translateObject() change them for
+    // both, the loaders give the renderer meshes of its own again. The window
+    // of a streamed terrain is refilled while rendering and is not shared.
+    void shareMeshes(const Renderer &other);
+
+    //// Drawing ////
+    // Everything below reads the scene from frame
+
+    // Line
+    void drawLine(Vertex start, Vertex end);
+
+    void Dda(Vertex start, Vertex end);
+    void Dda_x(Vertex start, Vertex end, double m);
+    void Dda_y(Vertex start, Vertex end, double w);
+
+    void Bresenhamm(Vertex start, Vertex end);
+    void Bresenhamm_x(Vertex start, Vertex end, double m);
+    void Bresenhamm_y(Vertex start, Vertex end, double m);
+
+    // Polygon
+    // void drawPolygon(std::list<Vertex> polygon) { drawPolygon(polygon, globalColor); }
+    void drawPolygon(std::list<Vertex> polygon, QColor color);
+    void drawPolygon(std::list<Vertex> polygon);
+    void fillPolygon(std::list<Vertex> polygon);
+    void fillTriangle(std::array<Vertex, 3> polygon);
+    size_t rasterizeTriangle(const std::array<Vertex, 3> &triangle);
+    RasterTarget rasterTarget();
+
+    // 3D Object
+    void drawObject()
+    {
+        if (!meshes->grid.isEmpty())
+            drawObject(meshes->grid, frame.camera, frame.lightSource, frame.coloringType);
+        else
+            drawObject(meshes->object, frame.camera, frame.lightSource, frame.coloringType);
+    }
+    void drawObject(const ThreeDObject &obj, const Camera &camera, const LightSource &light, ColoringType coloring);
+    void transformVertices(const ThreeDObject &object, const QMatrix4x4 &transform);
+    void calculateColors(const ThreeDObject &object, const Lighting &lighting, ColoringType coloring);
+    void drawObject(const ThreeDObject *object, ColoringType coloring);
+    // Normals for the z scale of the frame, calculateColors() keeps them up to
+    // date. False if they all were.
+    bool updateNormals(const ThreeDObject &object);
+    bool updateNormals(const HeightfieldMesh &mesh); // of the visible chunks
+    bool updateFaceNormals(const HeightfieldMesh &mesh); // of the visible chunks at their levels
+    void invalidateNormals() { normals.invalidate(); } // the mesh drawn was changed in place
+
+    // Heightfield
+    void drawObject(const HeightfieldMesh &mesh, const Camera &camera, const LightSource &light, ColoringType coloring);
+    void transformVertices(const HeightfieldMesh &mesh, const QMatrix4x4 &transform);
+    void calculateColors(const HeightfieldMesh &mesh, const Lighting &lighting, ColoringType coloring);
+    void drawObject(const HeightfieldMesh *mesh, ColoringType coloring);
+    void setRasterTriangle(size_t face, ColoringType coloring, RasterVertex v[3]);
+    void prepareNormals(const HeightfieldMesh &mesh);
+    MeshNormals::Face chunkFaceNormal(const HeightfieldMesh &mesh, const TerrainChunk &chunk,
+                                      const GridTriangle &face) const;
+
+    // Heightfield chunks, simplified to the coarsest mip level within the LOD tolerance,
+    // drawn front to back and skipped when the Hi-Z shows them hidden
+    void selectLevels(const QMatrix4x4 &transform);
+    void buildChunkFaces(const HeightfieldMesh &mesh);
+    void boundChunks(const HeightfieldMesh &mesh); // screen bounds of the visible chunks
+    void sortChunks();                             // front to back
+    void drawChunks(const HeightfieldMesh *mesh, ColoringType coloring);
+
+    bool isChunkOccluded(const TerrainChunk &chunk);
+    void updateDepthPyramid(float min_x, float min_y, float max_x, float max_y);
+
+    // Streamed terrain window
+    void updateTerrainWindow();
+    void fillTerrainWindow(int level, int row, int col, int rows, int cols);
+
+    // Model (zoom and z scale), view (camera) and projection (including viewport) matrices.
+    // Their product is applied to the vertices in one pass by transformPoints().
+    QMatrix4x4 modelMatrix() const;
+    QMatrix4x4 viewMatrix(const Camera &camera) const;
+    QMatrix4x4 projectionMatrix(const Camera &camera) const;
+    QVector4D viewerPosition(const QMatrix4x4 &model_view, const Camera &camera) const;
+
+    // Faces with the normal pointing away from the viewer, point is any vertex of the face.
+    // Only filled faces are culled, a wireframe keeps its back edges.
+    bool isBackFacing(QVector3D normal, QVector3D point, ColoringType coloring) const
+    {
+        return frame.backface_culling && coloring != WIREFRAME &&
+               QVector3D::dotProduct(normal, viewer.toVector3D() - viewer.w() * point) < 0;
+    }
+
+    // Stages working on the render buffers
+    void setScreenVertex(Vertex &vertex, unsigned int i, ColoringType coloring, size_t face);
+    void drawTriangle(const std::array<Vertex, 3> &triangle, ColoringType coloring);
+
+    // Phong lighting of a single point, with the light and the eye moved to world coordinates
+    Lighting prepareLighting(const QMatrix4x4 &view, const LightSource &light) const;
+    QRgb shade(QVector3D point, QVector3D normal, QRgb color, const Lighting &lighting);
+
+    //// Clipping ////
+
+    // Cyrus-Beck
+    void clipLine(Vertex start, Vertex end, Vertex &clip_start, Vertex &clip_end);
+
+    // Sutherland-Hodgman
+    void clipPolygonLeftSide(std::list<Vertex> &polygon, int x_min);
+    void clipPolygon(std::list<Vertex> &polygon);
+
+    // Get/Set functions
+    uchar *getData() { return data; }
+    void setDataPtr() { data = img.bits(); }
+
+    int getImgWidth() { return img.width(); };
+    int getImgHeight() { return img.height(); };
+
+    void clearBuffers();
+};
@@ -0,0 +1,141 @@
+#include "RtinMesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+bool RtinMesh::isSupported(int rows, int cols)
+{
+    int cells = rows - 1;
+    return rows == cols && cells >= 2 && (cells & (cells - 1)) == 0;
+}
+
+bool RtinMesh::build(const HeightGrid &grid)
+{
+    clear();
+    if (grid.isEmpty() || !isSupported(grid.rows, grid.cols))
+        return false;
+
+    grid_size = grid.rows;
+    points.resize((size_t)grid.rows * grid.cols);
+    for (int row = 0, i = 0; row < grid.rows; row++)
+    {
+        for (int col = 0; col < grid.cols; col++, i++)
+            points[i] = grid.point(row, col);
+    }
+    errors.assign(points.size(), 0);
+    output_index.assign(points.size(), ~0u);
+
+    // Triangles are numbered like a binary heap: 2 and 3 are the roots and the
+    // children of t are 2t and 2t + 1. Children are measured before their
+    // parents, so a split point already holds the errors of the points below it.
+    int tile = grid_size - 1;
+    size_t triangles = 2 * (size_t)tile * tile - 2;
+    size_t parents = triangles - (size_t)tile * tile;
+    for (size_t i = triangles; i-- > 0;)
+    {
+        size_t id = i + 2;
+        int ax = 0, ay = 0, bx = 0, by = 0, cx = 0, cy = 0;
+        if (id & 1)
+            bx = by = cx = tile;
+        else
+            ax = ay = cy = tile;
+        while ((id >>= 1) > 1)
+        {
+            int mx = (ax + bx) >> 1;
+            int my = (ay + by) >> 1;
+            if (id & 1)
+            {
+                bx = ax;
+                by = ay;
+                ax = cx;
+                ay = cy;
+            }
+            else
+            {
+                ax = bx;
+                ay = by;
+                bx = cx;
+                by = cy;
+            }
+            cx = mx;
+            cy = my;
+        }
+
+        float interpolated = (points[ay * grid_size + ax].z() + points[by * grid_size + bx].z()) / 2;
+        size_t middle = ((ay + by) >> 1) * grid_size + ((ax + bx) >> 1);
+        float error = std::max(errors[middle], std::fabs(interpolated - points[middle].z()));
+        if (i < parents)
+        {
+            size_t left = ((ay + cy) >> 1) * grid_size + ((ax + cx) >> 1);
+            size_t right = ((by + cy) >> 1) * grid_size + ((bx + cx) >> 1);
+            error = std::max({error, errors[left], errors[right]});
+        }
+        errors[middle] = error;
+    }
+    return true;
+}
+void RtinMesh::clear()
+{
+    grid_size = 0;
+    points.clear();
+    errors.clear();
+    output_index.clear();
+    used.clear();
+}
+
+float RtinMesh::maxError() const
+{
+    if (isEmpty())
+        return 0;
+    int middle = (grid_size - 1) / 2;
+    return errors[middle * grid_size + middle];
+}
+
+void RtinMesh::triangulate(float max_error, std::vector<QVector3D> &vertices, std::vector<std::vector<unsigned int>> &triangles)
+{
+    vertices.clear();
+    triangles.clear();
+    if (isEmpty())
+        return;
+
+    int tile = grid_size - 1;
+    addTriangle(0, 0, tile, tile, tile, 0, max_error, vertices, triangles);
+    addTriangle(tile, tile, 0, 0, 0, tile, max_error, vertices, triangles);
+
+    // Only the entries that were taken are reset
+    for (unsigned index : used)
+        output_index[index] = ~0u;
+    used.clear();
+}
+
+void RtinMesh::addTriangle(int ax, int ay, int bx, int by, int cx, int cy, float max_error,
+                           std::vector<QVector3D> &vertices, std::vector<std::vector<unsigned int>> &triangles)
+{
+    // a, b is the hypotenuse and c the right angle
+    int mx = (ax + bx) >> 1;
+    int my = (ay + by) >> 1;
+    if (std::abs(ax - cx) + std::abs(ay - cy) > 1 && errors[my * grid_size + mx] > max_error)
+    {
+        addTriangle(cx, cy, ax, ay, mx, my, max_error, vertices, triangles);
+        addTriangle(bx, by, cx, cy, mx, my, max_error, vertices, triangles);
+        return;
+    }
+
+    // (a, b, c) turns the other way than the grid triangles
+    unsigned a = vertex(ax, ay, vertices);
+    unsigned b = vertex(bx, by, vertices);
+    unsigned c = vertex(cx, cy, vertices);
+    triangles.push_back({a, c, b});
+}
+
+unsigned RtinMesh::vertex(int x, int y, std::vector<QVector3D> &vertices)
+{
+    size_t index = (size_t)y * grid_size + x;
+    if (output_index[index] == ~0u)
+    {
+        output_index[index] = (unsigned)vertices.size();
+        vertices.push_back(points[index]);
+        used.push_back((unsigned)index);
+    }
+    return output_index[index];
+}
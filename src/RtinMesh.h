@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QVector3D>
+#include <vector>
+#include "HeightfieldMesh.h"
+
+// Right-triangulated irregular network over a square grid of (2^k + 1)^2 points.
+//
+// Triangles are right isosceles and split in half at the midpoint of their
+// hypotenuse, starting from the two halves of the whole grid. build() computes
+// once, for every split point, the largest vertical distance between the grid
+// and the interpolated surface of the triangles that leave it out. The error of
+// a point includes the errors of the splits below it, so whenever a triangle is
+// split the neighbour sharing its hypotenuse is split too and the mesh never has
+// T-junctions. triangulate() then only walks the triangles it outputs.
+class RtinMesh
+{
+public:
+    // Grids of 2^k + 1 points per side, k >= 1
+    static bool isSupported(int rows, int cols);
+
+    // Returns false for unsupported sizes
+    bool build(const HeightGrid &grid);
+    void clear();
+    bool isEmpty() const { return points.empty(); }
+    int size() const { return grid_size; }
+
+    // Error of the two root triangles, anything at or above it gives 2 triangles
+    float maxError() const;
+
+    // Adaptive mesh whose vertical error stays within max_error: the grid
+    // points it uses and triangles indexing into them, wound like the
+    // triangles of HeightfieldMesh. Runs in time linear in the output.
+    void triangulate(float max_error, std::vector<QVector3D> &vertices, std::vector<std::vector<unsigned int>> &triangles);
+
+private:
+    void addTriangle(int ax, int ay, int bx, int by, int cx, int cy, float max_error,
+                     std::vector<QVector3D> &vertices, std::vector<std::vector<unsigned int>> &triangles);
+    unsigned vertex(int x, int y, std::vector<QVector3D> &vertices);
+
+    int grid_size = 0;             // points per side
+    std::vector<QVector3D> points; // row-major, index y * grid_size + x
+    std::vector<float> errors;     // per split point, 0 elsewhere
+
+    // Output index of every grid point during triangulate(), ~0u when unused
+    std::vector<unsigned> output_index;
+    std::vector<unsigned> used;
+};
@@ -0,0 +1,163 @@
+#include "TerrainStreamer.h"
+
+// Smallest budget, in tiles; below the tiles of one view the cache would thrash
+static const size_t MIN_BUDGET_TILES = 32;
+
+bool TerrainStreamer::open(const QString &filename, const QFileInfo &source)
+{
+    close();
+    if (!tiles.open(filename, source))
+        return false;
+
+    auto tile = std::make_shared<TerrainTile>();
+    tile->key = {tiles.levels() - 1, 0, 0};
+    tile->heights.resize(tiles.tileSamples());
+    if (!tiles.readTile(tile->key.level, 0, 0, tile->heights.data()))
+    {
+        tiles.close();
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    root = tile;
+    counters = StreamingStats();
+    counters.budget_bytes = std::max(DEFAULT_BUDGET, MIN_BUDGET_TILES * tiles.tileSamples() * sizeof(float));
+    counters.resident_bytes = root->heights.size() * sizeof(float);
+    counters.resident_tiles = 1;
+    counters.loads = 1;
+    stopping = false;
+    loader = std::thread(&TerrainStreamer::loadLoop, this);
+    return true;
+}
+void TerrainStreamer::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (loader.joinable())
+        loader.join();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    lru.clear();
+    cached.clear();
+    queue.clear();
+    root.reset();
+    counters = StreamingStats();
+    tiles.close();
+}
+
+void TerrainStreamer::setBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.budget_bytes = std::max(bytes, MIN_BUDGET_TILES * tiles.tileSamples() * sizeof(float));
+    evict();
+}
+void TerrainStreamer::setLoadedCallback(std::function<void()> callback)
+{
+    std::lock_guard<std::mutex> lock(callback_mutex);
+    loaded_callback = callback;
+}
+
+void TerrainStreamer::request(const std::vector<TileKey> &keys)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.clear();
+        for (const TileKey &key : keys)
+        {
+            if (cached.count(key.id()) == 0 && !(root && key == root->key))
+                queue.push_back(key);
+        }
+        counters.queued = queue.size();
+    }
+    wake.notify_one();
+}
+
+std::shared_ptr<const TerrainTile> TerrainStreamer::find(const TileKey &key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (root && key == root->key)
+    {
+        counters.hits++;
+        return root;
+    }
+    auto it = cached.find(key.id());
+    if (it == cached.end())
+    {
+        counters.misses++;
+        return nullptr;
+    }
+    counters.hits++;
+    lru.splice(lru.begin(), lru, it->second);
+    return *it->second;
+}
+
+uint64_t TerrainStreamer::generation() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return loaded_generation;
+}
+StreamingStats TerrainStreamer::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+void TerrainStreamer::loadLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (stopping)
+            return;
+
+        TileKey key = queue.front();
+        queue.pop_front();
+        counters.queued = queue.size();
+        if (cached.count(key.id()) != 0)
+            continue;
+
+        // The file is read without holding the lock
+        lock.unlock();
+        auto tile = std::make_shared<TerrainTile>();
+        tile->key = key;
+        tile->heights.resize(tiles.tileSamples());
+        bool ok = tiles.readTile(key.level, key.x, key.y, tile->heights.data());
+        lock.lock();
+        if (!ok || stopping)
+            continue;
+
+        lru.push_front(tile);
+        cached[key.id()] = lru.begin();
+        counters.resident_bytes += tile->heights.size() * sizeof(float);
+        counters.resident_tiles++;
+        counters.loads++;
+        loaded_generation++;
+        evict();
+
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> callback_lock(callback_mutex);
+            if (loaded_callback)
+                loaded_callback();
+        }
+        lock.lock();
+    }
+}
+
+void TerrainStreamer::evict()
+{
+    // The newest tile stays even if it alone exceeds the budget
+    while (counters.resident_bytes > counters.budget_bytes && lru.size() > 1)
+    {
+        const TerrainTile &tile = *lru.back();
+        counters.resident_bytes -= tile.heights.size() * sizeof(float);
+        counters.resident_tiles--;
+        counters.evictions++;
+        cached.erase(tile.key.id());
+        lru.pop_back();
+    }
+}
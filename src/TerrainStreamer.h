@@ -0,0 +1,97 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "TilePyramid.h"
+
+struct TileKey
+{
+    int level, x, y;
+
+    bool operator==(const TileKey &other) const { return level == other.level && x == other.x && y == other.y; }
+    uint64_t id() const { return (uint64_t)level << 56 | (uint64_t)y << 28 | (uint64_t)x; }
+};
+
+struct TerrainTile
+{
+    TileKey key;
+    std::vector<float> heights; // TilePyramid::tileSamples(), row-major
+};
+
+// Counters of a TerrainStreamer since it was opened
+struct StreamingStats
+{
+    size_t resident_bytes = 0; // heights of the cached tiles
+    size_t budget_bytes = 0;
+    size_t resident_tiles = 0;
+    size_t hits = 0;   // find() with the tile in memory
+    size_t misses = 0; // find() without it
+    size_t loads = 0;
+    size_t evictions = 0;
+    size_t queued = 0; // requested tiles not loaded yet
+};
+
+// Streams the tiles of a TilePyramid from disk into an LRU cache.
+//
+// A loader thread reads the tiles passed to request(), in that order; every
+// request replaces the previous one, so only the tiles the latest view needs
+// are read. Loaded tiles are kept, least recently used first out, for as long
+// as they fit the memory budget. The single tile of the coarsest level is read
+// by open() and never evicted, so some height is known everywhere.
+// All functions may be called from any thread.
+class TerrainStreamer
+{
+public:
+    static constexpr size_t DEFAULT_BUDGET = (size_t)256 << 20;
+
+    TerrainStreamer() {}
+    ~TerrainStreamer() { close(); }
+    TerrainStreamer(const TerrainStreamer &) = delete;
+    TerrainStreamer &operator=(const TerrainStreamer &) = delete;
+
+    bool open(const QString &filename, const QFileInfo &source);
+    void close();
+
+    // Geometry of the pyramid, fixed while open
+    const TilePyramid &pyramid() const { return tiles; }
+
+    void setBudget(size_t bytes);
+    // Called on the loader thread after every loaded tile
+    void setLoadedCallback(std::function<void()> callback);
+
+    // Replaces the queue of tiles to load, most wanted first
+    void request(const std::vector<TileKey> &keys);
+    // Cached tile or nullptr, counted as a hit or a miss
+    std::shared_ptr<const TerrainTile> find(const TileKey &key);
+    // Increases whenever a tile arrives
+    uint64_t generation() const;
+    StreamingStats stats() const;
+
+private:
+    typedef std::list<std::shared_ptr<const TerrainTile>> TileList;
+
+    void loadLoop();
+    void evict(); // called with mutex locked
+
+    TilePyramid tiles; // read by the loader thread only after open()
+    std::thread loader;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    TileList lru; // most recently used first
+    std::unordered_map<uint64_t, TileList::iterator> cached;
+    std::shared_ptr<const TerrainTile> root; // coarsest level, not in lru
+    std::deque<TileKey> queue;
+    StreamingStats counters;
+    uint64_t loaded_generation = 0;
+    bool stopping = false;
+
+    std::mutex callback_mutex;
+    std::function<void()> loaded_callback;
+};
@@ -22,6 +22,10 @@ ThreeDViewer ::ThreeDViewer(QWidget *parent)
 	ui->global_color->setStyleSheet(style_sheet);
 	vW->setGlobalColor(default_color);
 	vW->setZScale(1);
+	ui->render_threads->setValue(vW->getThreadCount());
+
+	// Culling counters of every finished frame
+	connect(vW, &ViewerWidget::frameReady, this, [this] { showCullingStats(); });
 
 	// Set light
 	default_color = Qt::white;
@@ -102,6 +106,11 @@ void ThreeDViewer ::ViewerWidgetMouseButtonPress(ViewerWidget *w, QEvent *event)
 		vW->setIsCameraRotating(true);
 		vW->setLastMousePos(e->position());
 	}
+	else if (e->button() == Qt::RightButton)
+	{
+		vW->setIsCameraPanning(true);
+		vW->setLastMousePos(e->position());
+	}
 }
 void ThreeDViewer ::ViewerWidgetMouseButtonRelease(ViewerWidget *w, QEvent *event)
 {
@@ -111,6 +120,10 @@ void ThreeDViewer ::ViewerWidgetMouseButtonRelease(ViewerWidget *w, QEvent *even
 	{
 		vW->setIsCameraRotating(false);
 	}
+	else if (e->button() == Qt::RightButton)
+	{
+		vW->setIsCameraPanning(false);
+	}
 }
 void ThreeDViewer ::ViewerWidgetMouseMove(ViewerWidget *w, QEvent *event)
 {
@@ -120,6 +133,10 @@ void ThreeDViewer ::ViewerWidgetMouseMove(ViewerWidget *w, QEvent *event)
 	{
 		vW->rotateCamera(e->position());
 	}
+	else if (vW->getIsCameraPanning())
+	{
+		vW->panCamera(e->position());
+	}
 }
 void ThreeDViewer ::ViewerWidgetLeave(ViewerWidget *w, QEvent *event)
 {
@@ -156,56 +173,105 @@ void ThreeDViewer ::closeEvent(QCloseEvent *event)
 // 3D Objects
 int ThreeDViewer ::loadObject(QString filename)
 {
-	QFile file(filename);
-	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	// A fresh tile pyramid is streamed without reading the terrain file at all
+	auto tiles = std::make_shared<TerrainStreamer>();
+	if (tiles->open(TilePyramid::pyramidPath(filename), QFileInfo(filename)))
 	{
-		QMessageBox::warning(this, "Error", "Could not open file");
-		return false;
+		const TilePyramidHeader &info = tiles->pyramid().info();
+		if (ui->stream_terrain->isChecked() || (size_t)info.rows * info.cols > STREAMED_TERRAIN_POINTS)
+		{
+			terrain_file = filename;
+			return showStreamedTerrain(tiles);
+		}
 	}
 
-	std::vector<QVector3D> points;
-	std::vector<std::vector<unsigned int>> polygons;
-
-	QTextStream in(&file);
-	QString line = in.readLine();
+	// Grids are read from their binary cache after the first load, large ones are mapped from it
+	auto dem = std::make_unique<DemFile>();
+	if (!dem->open(filename))
+	{
+		QMessageBox::warning(this, "Error", QString("Could not load %1\n%2").arg(filename).arg(dem->errorString()));
+		return false;
+	}
 
-	while (!line.isNull())
+	terrain_file = filename;
+	size_t points = (size_t)dem->rows() * dem->cols();
+	if (ui->stream_terrain->isChecked() || points > STREAMED_TERRAIN_POINTS)
 	{
-		QStringList list = line.split(" ");
-		std::vector<double> coordinates;
+		dem.reset(); // the pyramid is built from the cache it was mapped from
+		return loadStreamedTerrain(filename);
+	}
 
-		// Try converting all strings to doubles
-		bool ok = true;
-		for (auto coordinate : list)
-		{
-			coordinates.push_back(coordinate.toDouble(&ok));
-			if (!ok)
-				return false;
-		}
+	streamer.reset();
+	terrain = std::move(dem);
+	rtin.build(terrain->grid());
+	ui->rtin_mesh->setEnabled(!rtin.isEmpty());
+	ui->rtin_error->setEnabled(!rtin.isEmpty() && ui->rtin_mesh->isChecked());
+	showTerrain();
+	return true;
+}
+bool ThreeDViewer ::loadStreamedTerrain(const QString &filename)
+{
+	// The pyramid is written once, next to the terrain file, and reused while the file is unchanged
+	QString path = TilePyramid::pyramidPath(filename);
+	QString error;
+	auto tiles = std::make_shared<TerrainStreamer>();
+	if (!TilePyramid::build(path, filename, &error) || !tiles->open(path, QFileInfo(filename)))
+	{
+		QMessageBox::warning(this, "Error", QString("Could not write the tiles of %1 to %2\n%3").arg(filename).arg(path).arg(error));
+		return false;
+	}
+	return showStreamedTerrain(tiles);
+}
+bool ThreeDViewer ::showStreamedTerrain(std::shared_ptr<TerrainStreamer> tiles)
+{
+	tiles->setBudget((size_t)ui->tile_cache->value() << 20);
 
-		QVector3D point = QVector3D(coordinates[0], coordinates[1], coordinates[2]);
+	// Only the tiles in view are in memory, the whole grid is not kept
+	terrain.reset();
+	rtin.clear();
+	ui->rtin_mesh->setEnabled(false);
+	ui->rtin_error->setEnabled(false);
 
-		// Add coordinates to rawObject
-		points.push_back(point);
+	streamer = tiles;
+	vW->loadStreamedTerrain(streamer);
+	return true;
+}
+void ThreeDViewer ::showTerrain()
+{
+	if (!terrain)
+		return;
 
-		line = in.readLine();
+	if (ui->rtin_mesh->isChecked() && !rtin.isEmpty())
+	{
+		std::vector<QVector3D> vertices;
+		std::vector<std::vector<unsigned int>> triangles;
+		rtin.triangulate(ui->rtin_error->value(), vertices, triangles);
+		vW->loadObject(vertices, triangles);
 	}
-
-	// Since we always have square input:
-	unsigned int n = sqrt(points.size());
-
-	// Create polygons
-	for (unsigned int row = 1; row < n; row++)
+	else
 	{
-		for (unsigned int col = 1; col < n; col++)
-		{
-			polygons.push_back({(row - 1) * n + (col - 1), (row - 1) * n + col, row * n + col});
-			polygons.push_back({(row - 1) * n + (col - 1), row * n + col, row * n + (col - 1)});
-		}
+		// Triangles of the grid are implied by its dimensions
+		vW->loadHeightfield(terrain->grid());
 	}
+}
+bool ThreeDViewer ::saveMesh(QString filename)
+{
+	QFile file(filename);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+		return false;
 
-	vW->loadObject(points, polygons);
-	return true;
+	std::vector<QVector3D> vertices;
+	std::vector<std::vector<unsigned int>> triangles;
+	rtin.triangulate(ui->rtin_error->value(), vertices, triangles);
+
+	// Wavefront OBJ, indices start at 1
+	QTextStream out(&file);
+	for (const QVector3D &vertex : vertices)
+		out << "v " << vertex.x() << " " << vertex.y() << " " << vertex.z() << "\n";
+	for (const std::vector<unsigned int> &triangle : triangles)
+		out << "f " << triangle[0] + 1 << " " << triangle[1] + 1 << " " << triangle[2] + 1 << "\n";
+	out.flush();
+	return file.error() == QFileDevice::NoError;
 }
 
 // Image functions
@@ -217,6 +283,39 @@ bool ThreeDViewer ::saveImage(QString filename)
 	QImage *img = vW->getImage();
 	return img->save(filename, extension.toStdString().c_str());
 }
+void ThreeDViewer ::showCullingStats()
+{
+	CullingStats stats = vW->getCullingStats();
+	size_t faces = stats.faces_drawn + stats.faces_occluded + stats.faces_outside + stats.faces_backfacing;
+	if (faces == 0)
+	{
+		ui->statusBar->clearMessage();
+		return;
+	}
+	QString message = QString("Faces drawn: %1, outside: %2, back-facing: %3, occluded: %4")
+						  .arg(stats.faces_drawn)
+						  .arg(stats.faces_outside)
+						  .arg(stats.faces_backfacing)
+						  .arg(stats.faces_occluded);
+	if (stats.chunks_drawn + stats.chunks_outside + stats.chunks_occluded > 0)
+		message += QString(" | Chunks drawn: %1, outside: %2, occluded: %3 | Faces simplified: %4")
+					   .arg(stats.chunks_drawn)
+					   .arg(stats.chunks_outside)
+					   .arg(stats.chunks_occluded)
+					   .arg(stats.faces_simplified);
+	if (streamer)
+	{
+		StreamingStats tiles = streamer->stats();
+		message += QString(" | Tiles: %1 (%2 of %3 MB), hits: %4, misses: %5, queued: %6")
+					   .arg(tiles.resident_tiles)
+					   .arg(tiles.resident_bytes >> 20)
+					   .arg(tiles.budget_bytes >> 20)
+					   .arg(tiles.hits)
+					   .arg(tiles.misses)
+					   .arg(tiles.queued);
+	}
+	ui->statusBar->showMessage(message);
+}
 
 // Slots
 void ThreeDViewer ::on_actionOpen_triggered()
@@ -224,7 +323,7 @@ void ThreeDViewer ::on_actionOpen_triggered()
 	QString folder = settings.value("folder_img_load_path", "").toString();
 
 	// QString fileFilter = "Image data (*.bmp *.gif *.jpg *.jpeg *.png *.pbm *.pgm *.ppm .*xbm .* xpm);;All files (*)";
-	QString fileFilter = "Dat súbor (*.dat)";
+	QString fileFilter = "Terrain (*.dat *.asc *.hgt);;Dat súbor (*.dat);;ESRI ASCII grid (*.asc);;SRTM tile (*.hgt)";
 
 	QString fileName = QFileDialog::getOpenFileName(this, "Load object", folder, fileFilter);
 	if (fileName.isEmpty())
@@ -267,10 +366,71 @@ void ThreeDViewer ::on_actionSave_as_triggered()
 		msgBox.exec();
 	}
 }
+void ThreeDViewer ::on_actionExport_mesh_triggered()
+{
+	if (rtin.isEmpty())
+	{
+		msgBox.setText("Mesh export needs a loaded square grid of 2^n + 1 points per side.");
+		msgBox.setIcon(QMessageBox::Warning);
+		msgBox.exec();
+		return;
+	}
+
+	QString folder = settings.value("folder_mesh_save_path", "").toString();
+	QString fileFilter = "Wavefront OBJ (*.obj)";
+	QString fileName = QFileDialog::getSaveFileName(this, "Export mesh", folder, fileFilter);
+	if (fileName.isEmpty())
+		return;
+
+	QFileInfo fi(fileName);
+	settings.setValue("folder_mesh_save_path", fi.absoluteDir().absolutePath());
+
+	if (!saveMesh(fileName))
+	{
+		msgBox.setText("Unable to export mesh.");
+		msgBox.setIcon(QMessageBox::Warning);
+	}
+	else
+	{
+		msgBox.setText(QString("Mesh with max error %1 saved to %2.").arg(ui->rtin_error->value()).arg(fileName));
+		msgBox.setIcon(QMessageBox::Information);
+	}
+	msgBox.exec();
+}
 void ThreeDViewer ::on_actionClear_triggered()
 {
 	vW->clear();
 }
+void ThreeDViewer ::on_actionRecord_trace_toggled(bool checked)
+{
+	if (checked)
+	{
+		vW->startTrace();
+		return;
+	}
+	vW->stopTrace();
+
+	QString folder = settings.value("folder_trace_save_path", "").toString();
+	QString fileFilter = "Chrome trace (*.json)";
+	QString fileName = QFileDialog::getSaveFileName(this, "Save trace", folder, fileFilter);
+	if (fileName.isEmpty())
+		return;
+
+	QFileInfo fi(fileName);
+	settings.setValue("folder_trace_save_path", fi.absoluteDir().absolutePath());
+
+	if (!vW->saveTrace(fileName))
+	{
+		msgBox.setText("Unable to save trace.");
+		msgBox.setIcon(QMessageBox::Warning);
+	}
+	else
+	{
+		msgBox.setText(QString("Trace saved to %1, open it in chrome://tracing or Perfetto.").arg(fileName));
+		msgBox.setIcon(QMessageBox::Information);
+	}
+	msgBox.exec();
+}
 void ThreeDViewer ::on_actionExit_triggered()
 {
 	this->close();
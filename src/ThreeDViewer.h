@@ -4,6 +4,9 @@
 #include <QtWidgets>
 #include "ui_ThreeDViewer.h"
 #include "ViewerWidget.h"
+#include "RtinMesh.h"
+#include "DemFile.h"
+#include "TerrainStreamer.h"
 
 class ThreeDViewer : public QMainWindow
 {
@@ -19,6 +22,15 @@ private:
 	QSettings settings;
 	QMessageBox msgBox;
 
+	// Loaded terrain, kept open to switch between the grid and the adaptive mesh
+	std::unique_ptr<DemFile> terrain;
+	RtinMesh rtin;
+
+	// Regular grids above this many points are always streamed from a tile pyramid
+	static const size_t STREAMED_TERRAIN_POINTS = (size_t)4097 * 4097;
+	QString terrain_file;
+	std::shared_ptr<TerrainStreamer> streamer;
+
 	// Event filters
 	bool eventFilter(QObject *obj, QEvent *event);
 
@@ -36,7 +48,11 @@ private:
 
 	// 3D Object functions
 	int loadObject(QString filename);
-	void drawObject() { vW->drawObject(); }
+	bool loadStreamedTerrain(const QString &filename);
+	bool showStreamedTerrain(std::shared_ptr<TerrainStreamer> tiles);
+	void showTerrain();
+	bool saveMesh(QString filename);
+	void drawObject() { vW->redraw(); }
 	void setCamera()
 	{
 		vW->setCamera(
@@ -46,11 +62,15 @@ private:
 
 	// Image functions
 	bool saveImage(QString filename);
+	void showCullingStats();
 
 private slots:
 	void on_actionOpen_triggered();
 	void on_actionSave_as_triggered();
+	void on_actionExport_mesh_triggered();
 	void on_actionClear_triggered();
+	void on_actionProfiler_overlay_toggled(bool checked) { vW->setProfilerOverlay(checked); }
+	void on_actionRecord_trace_toggled(bool checked);
 	void on_actionExit_triggered();
 
 	//// Tools slots ////
@@ -59,13 +79,39 @@ private slots:
 	void on_global_color_clicked();
 	void on_alg_type_currentIndexChanged(int index)
 	{
-		vW->setRasterizationAlgorithm(index == 0 ? ViewerWidget::DDA : ViewerWidget::BRESENHAMM);
+		vW->setRasterizationAlgorithm(
+			index == 0 ? Renderer::DDA : index == 1 ? Renderer::BRESENHAMM
+														: Renderer::EDGE_FUNCTION);
+	}
+	void on_render_threads_valueChanged(int threads) { vW->setThreadCount(threads); }
+	void on_occlusion_culling_toggled(bool checked) { vW->setOcclusionCulling(checked); }
+	void on_backface_culling_toggled(bool checked) { vW->setBackfaceCulling(checked); }
+	void on_lod_tolerance_valueChanged(double pixels) { vW->setLodTolerance(pixels); }
+	void on_rtin_mesh_toggled(bool checked)
+	{
+		ui->rtin_error->setEnabled(checked);
+		showTerrain();
+	}
+	void on_rtin_error_valueChanged(double error)
+	{
+		if (ui->rtin_mesh->isChecked())
+			showTerrain();
+	}
+	void on_stream_terrain_toggled(bool checked)
+	{
+		if (!terrain_file.isEmpty())
+			loadObject(terrain_file);
+	}
+	void on_tile_cache_valueChanged(int megabytes)
+	{
+		if (streamer)
+			streamer->setBudget((size_t)megabytes << 20);
 	}
 	void on_coloring_type_currentIndexChanged(int index)
 	{
 		vW->setColoringType(
-			index == 0 ? ViewerWidget::WIREFRAME : index == 1 ? ViewerWidget::VERTEX
-															  : ViewerWidget::SIDE);
+			index == 0 ? Renderer::WIREFRAME : index == 1 ? Renderer::VERTEX
+															  : Renderer::SIDE);
 	}
 
 	// Camera slots
@@ -0,0 +1,129 @@
+#include "TilePyramid.h"
+
+#include <QSaveFile>
+#include <QDateTime>
+#include <cstring>
+
+static const char PYRAMID_MAGIC[8] = {'D', 'E', 'M', 'T', 'I', 'L', 'E', 'S'};
+static_assert(sizeof(TilePyramidHeader) == 88, "TilePyramidHeader is written as is");
+
+bool TilePyramid::build(const QString &filename, const QString &terrain_file, QString *error, int tile_cells)
+{
+    DemFile dem;
+    if (!dem.open(terrain_file))
+    {
+        if (error != nullptr)
+            *error = dem.errorString();
+        return false;
+    }
+    HeightGrid heights = dem.grid();
+    if (heights.isEmpty())
+        return false;
+
+    TilePyramid pyramid;
+    TilePyramidHeader &header = pyramid.header;
+    std::memcpy(header.magic, PYRAMID_MAGIC, sizeof(PYRAMID_MAGIC));
+    header.version = VERSION;
+    header.rows = dem.rows();
+    header.cols = dem.cols();
+    header.tile_cells = tile_cells;
+    header.levels = 1;
+    while (pyramid.tilesX(header.levels - 1) > 1 || pyramid.tilesY(header.levels - 1) > 1)
+        header.levels++;
+    header.min_z = dem.info().min_z;
+    header.max_z = dem.info().max_z;
+    header.origin_x = dem.info().origin_x;
+    header.origin_y = dem.info().origin_y;
+    header.spacing_x = dem.info().spacing_x;
+    header.spacing_y = dem.info().spacing_y;
+    header.source_size = dem.info().source_size;
+    header.source_mtime = dem.info().source_mtime;
+
+    QSaveFile file(filename);
+    auto fail = [&] {
+        if (error != nullptr)
+            *error = QString("Could not write %1: %2").arg(filename).arg(file.errorString());
+        file.cancelWriting();
+        return false;
+    };
+    if (!file.open(QIODevice::WriteOnly) ||
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header)) != (qint64)sizeof(header))
+        return fail();
+
+    std::vector<float> tile(pyramid.tileSamples());
+    qint64 tile_bytes = tile.size() * sizeof(float);
+    for (int level = 0; level < header.levels; level++)
+    {
+        int last_row = pyramid.levelRows(level) - 1;
+        int last_col = pyramid.levelCols(level) - 1;
+        for (int tile_y = 0; tile_y < pyramid.tilesY(level); tile_y++)
+        {
+            for (int tile_x = 0; tile_x < pyramid.tilesX(level); tile_x++)
+            {
+                float *sample = tile.data();
+                for (int i = 0; i <= tile_cells; i++)
+                {
+                    int row = pyramid.fullRow(level, std::min(tile_y * tile_cells + i, last_row));
+                    for (int j = 0; j <= tile_cells; j++)
+                        *sample++ = heights.height(row, pyramid.fullCol(level, std::min(tile_x * tile_cells + j, last_col)));
+                }
+                if (file.write(reinterpret_cast<const char *>(tile.data()), tile_bytes) != tile_bytes)
+                    return fail();
+            }
+        }
+    }
+    return file.commit() || fail();
+}
+
+bool TilePyramid::open(const QString &filename, const QFileInfo &source)
+{
+    close();
+    file.setFileName(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    TilePyramidHeader stored;
+    bool valid = file.read(reinterpret_cast<char *>(&stored), sizeof(stored)) == (qint64)sizeof(stored) &&
+                 std::memcmp(stored.magic, PYRAMID_MAGIC, sizeof(PYRAMID_MAGIC)) == 0 && stored.version == VERSION &&
+                 stored.rows > 1 && stored.cols > 1 && stored.tile_cells > 0 && stored.levels > 0;
+    bool fresh = stored.source_size == source.size() &&
+                 stored.source_mtime == source.lastModified().toMSecsSinceEpoch();
+    if (!valid || !fresh)
+    {
+        file.close();
+        return false;
+    }
+
+    header = stored;
+    computeOffsets();
+    if (file.size() != level_offsets.back())
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+void TilePyramid::close()
+{
+    if (file.isOpen())
+        file.close();
+    header = TilePyramidHeader();
+    level_offsets.clear();
+}
+
+bool TilePyramid::readTile(int level, int tile_x, int tile_y, float *heights)
+{
+    qint64 bytes = tileSamples() * sizeof(float);
+    qint64 offset = level_offsets[level] + ((qint64)tile_y * tilesX(level) + tile_x) * bytes;
+    return file.seek(offset) && file.read(reinterpret_cast<char *>(heights), bytes) == bytes;
+}
+
+// Offsets of all levels and, last, the end of the file
+void TilePyramid::computeOffsets()
+{
+    qint64 bytes = tileSamples() * sizeof(float);
+    level_offsets.resize(header.levels + 1);
+    level_offsets[0] = sizeof(TilePyramidHeader);
+    for (int level = 0; level < header.levels; level++)
+        level_offsets[level + 1] = level_offsets[level] + (qint64)tilesX(level) * tilesY(level) * bytes;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <QFile>
+#include <QFileInfo>
+#include <QString>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "DemFile.h"
+
+// Header of a tile pyramid file. Level l keeps every 2^l-th row and column of
+// the full resolution grid, the last row and column always included. Every
+// level is cut into tiles of tile_cells x tile_cells cells; a tile holds
+// (tile_cells + 1)^2 float32 heights, so neighbouring tiles share their border
+// samples, and tiles reaching past the level repeat its last row and column.
+// The tiles follow the header level by level, row-major within a level.
+struct TilePyramidHeader
+{
+    char magic[8]; // "DEMTILES"
+    uint32_t version;
+    int32_t rows, cols; // full resolution
+    int32_t tile_cells;
+    int32_t levels; // the last one is a single tile
+    float min_z, max_z;
+    uint32_t reserved;
+    double origin_x, origin_y;
+    double spacing_x, spacing_y;
+    int64_t source_size;  // of the file the pyramid was made from, see DemHeader
+    int64_t source_mtime;
+};
+
+// Multi-resolution tiled copy of a regular DEM on disk, for grids too large
+// to be loaded at once. Only the tiles asked for are read.
+class TilePyramid
+{
+public:
+    static const uint32_t VERSION = 1;
+    static const int TILE_CELLS = 256;
+
+    static QString pyramidPath(const QString &filename) { return filename + ".tiles"; }
+
+    // Writes the pyramid of the grid in terrain_file. The heights are read tile
+    // by tile from the mapped DemFile cache or SRTM tile; a large text grid is
+    // converted into its cache first, so it is never held in memory. Why it
+    // failed is put in error, if given.
+    static bool build(const QString &filename, const QString &terrain_file, QString *error = nullptr,
+                      int tile_cells = TILE_CELLS);
+
+    // Fails for pyramids not made from source as it is now
+    bool open(const QString &filename, const QFileInfo &source);
+    void close();
+    bool isOpen() const { return file.isOpen(); }
+
+    const TilePyramidHeader &info() const { return header; }
+    int levels() const { return header.levels; }
+    int tileCells() const { return header.tile_cells; }
+    size_t tileSamples() const { return (size_t)(header.tile_cells + 1) * (header.tile_cells + 1); }
+    int levelRows(int level) const { return levelSize(header.rows, level); }
+    int levelCols(int level) const { return levelSize(header.cols, level); }
+    int tilesX(int level) const { return tileCount(levelCols(level)); }
+    int tilesY(int level) const { return tileCount(levelRows(level)); }
+
+    // Full resolution row or column of sample index of level
+    int fullRow(int level, int row) const { return std::min(row << level, header.rows - 1); }
+    int fullCol(int level, int col) const { return std::min(col << level, header.cols - 1); }
+
+    // tileSamples() heights, row-major; not thread safe
+    bool readTile(int level, int tile_x, int tile_y, float *heights);
+
+private:
+    static int levelSize(int size, int level) { return (size - 1 + (1 << level) - 1) / (1 << level) + 1; }
+    int tileCount(int samples) const { return std::max(1, (samples - 1 + header.tile_cells - 1) / header.tile_cells); }
+    void computeOffsets();
+
+    TilePyramidHeader header = {};
+    QFile file;
+    std::vector<qint64> level_offsets; // file offset of the first tile of every level
+};
@@ -0,0 +1,87 @@
+#include "TiledRasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Tiles [first, last] overlapped by the pixels min .. max, false when there are none.
+    // One pixel of margin covers the rounding to the rasterizer's sub-pixel grid.
+    bool tileSpan(float min, float max, int origin, int tiles, int &first, int &last)
+    {
+        float first_tile = std::floor((min - 1 - origin) / TiledRasterizer::TILE_SIZE);
+        float last_tile = std::floor((max + 1 - origin) / TiledRasterizer::TILE_SIZE);
+        if (!(last_tile >= 0 && first_tile < tiles)) // also rejects NaN
+            return false;
+        first = first_tile < 0 ? 0 : (int)first_tile;
+        last = last_tile >= tiles ? tiles - 1 : (int)last_tile;
+        return true;
+    }
+}
+
+size_t TiledRasterizer::draw(const RasterTarget &target, size_t count, const TriangleSetup &setup)
+{
+    int width = target.clip_right - target.clip_left, height = target.clip_bottom - target.clip_top;
+    if (count == 0 || width <= 0 || height <= 0)
+        return 0;
+
+    int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    size_t tiles = (size_t)tiles_x * tiles_y;
+    size_t ranges = pool.threadCount();
+    bins.resize(ranges * tiles);
+    covered.assign(tiles, 0);
+
+    // Binning
+    auto binRange = [&](size_t range)
+    {
+        std::vector<uint32_t> *range_bins = &bins[range * tiles];
+        for (size_t tile = 0; tile < tiles; tile++)
+            range_bins[tile].clear();
+
+        RasterVertex v[3];
+        for (size_t t = count * range / ranges; t < count * (range + 1) / ranges; t++)
+        {
+            setup(t, v);
+            int first_x, last_x, first_y, last_y;
+            if (!tileSpan(std::min({v[0].x, v[1].x, v[2].x}), std::max({v[0].x, v[1].x, v[2].x}),
+                          target.clip_left, tiles_x, first_x, last_x) ||
+                !tileSpan(std::min({v[0].y, v[1].y, v[2].y}), std::max({v[0].y, v[1].y, v[2].y}),
+                          target.clip_top, tiles_y, first_y, last_y))
+                continue;
+
+            for (int tile_y = first_y; tile_y <= last_y; tile_y++)
+                for (int tile_x = first_x; tile_x <= last_x; tile_x++)
+                    range_bins[tile_y * tiles_x + tile_x].push_back((uint32_t)t);
+        }
+    };
+    pool.run(ranges, binRange);
+
+    // Rasterization, tile by tile
+    auto drawTile = [&](size_t tile)
+    {
+        RasterTarget tile_target = target;
+        tile_target.clip_left = target.clip_left + (int)(tile % tiles_x) * TILE_SIZE;
+        tile_target.clip_top = target.clip_top + (int)(tile / tiles_x) * TILE_SIZE;
+        tile_target.clip_right = std::min(target.clip_right, tile_target.clip_left + TILE_SIZE);
+        tile_target.clip_bottom = std::min(target.clip_bottom, tile_target.clip_top + TILE_SIZE);
+
+        size_t pixels = 0;
+        RasterVertex v[3];
+        for (size_t range = 0; range < ranges; range++)
+        {
+            for (uint32_t t : bins[range * tiles + tile])
+            {
+                setup(t, v);
+                pixels += rasterizeTriangle(tile_target, v[0], v[1], v[2]);
+            }
+        }
+        covered[tile] = pixels;
+    };
+    pool.run(tiles, drawTile);
+
+    size_t pixels = 0;
+    for (size_t tile_pixels : covered)
+        pixels += tile_pixels;
+    return pixels;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "TriangleRasterizer.h"
+#include "WorkerPool.h"
+
+// Parallel triangle rasterization over square screen tiles.
+//
+// Triangles are first binned into the tiles their bounding box overlaps, then
+// every tile is rasterized by one worker with the target clipped to the tile.
+// A tile owns its pixels and depth values, so no locking is needed, and its
+// triangles are drawn in submission order, which gives exactly the image of
+// calling rasterizeTriangle() for one triangle after another.
+class TiledRasterizer
+{
+public:
+    static const int TILE_SIZE = 64;
+
+    // Fills in the screen vertices of triangle t, called from the worker threads
+    using TriangleSetup = std::function<void(size_t t, RasterVertex vertices[3])>;
+
+    explicit TiledRasterizer(int threads = 0) : pool(threads) {}
+
+    void setThreadCount(int threads) { pool.setThreadCount(threads); }
+    int threadCount() const { return pool.threadCount(); }
+
+    // Draws triangles 0 .. count - 1, returns the number of covered pixels
+    size_t draw(const RasterTarget &target, size_t count, const TriangleSetup &setup);
+
+private:
+    WorkerPool pool;
+
+    // Each worker bins a contiguous range of triangles, bins[range * tiles + tile]
+    std::vector<std::vector<uint32_t>> bins;
+    std::vector<size_t> covered; // per tile
+};
@@ -0,0 +1,141 @@
+#include "TriangleRasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace
+{
+    const int64_t SUBPIXEL = 1 << RASTER_SUBPIXEL_BITS;
+
+    struct FixedPoint
+    {
+        int64_t x, y;
+    };
+
+    FixedPoint snap(const RasterVertex &v)
+    {
+        return {(int64_t)std::lround(v.x * SUBPIXEL), (int64_t)std::lround(v.y * SUBPIXEL)};
+    }
+
+    // Twice the signed area of (a, b, p), positive when p lies to the inner side of a -> b
+    int64_t edge(const FixedPoint &a, const FixedPoint &b, int64_t px, int64_t py)
+    {
+        return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+    }
+
+    // Top-left fill rule for the positive orientation of edge() on a y-down screen
+    bool isTopLeft(const FixedPoint &a, const FixedPoint &b)
+    {
+        int64_t dx = b.x - a.x, dy = b.y - a.y;
+        return (dy == 0 && dx > 0) || dy < 0;
+    }
+
+    // Larger coordinates would overflow the 64 bit edge functions
+    const float MAX_COORDINATE = 1 << 21;
+
+    bool isRepresentable(const RasterVertex &v)
+    {
+        return std::fabs(v.x) < MAX_COORDINATE && std::fabs(v.y) < MAX_COORDINATE;
+    }
+
+    inline int channel(float value)
+    {
+        return value <= 0 ? 0 : value >= 255 ? 255 : (int)(value + 0.5f);
+    }
+}
+
+size_t rasterizeTriangle(const RasterTarget &target, const RasterVertex &v0, const RasterVertex &in_v1, const RasterVertex &in_v2)
+{
+    if (!isRepresentable(v0) || !isRepresentable(in_v1) || !isRepresentable(in_v2))
+        return 0;
+
+    FixedPoint p0 = snap(v0), p1 = snap(in_v1), p2 = snap(in_v2);
+
+    // Orient the triangle positively, degenerate triangles cover nothing
+    int64_t area = edge(p0, p1, p2.x, p2.y);
+    if (area == 0)
+        return 0;
+    const RasterVertex *v1 = &in_v1, *v2 = &in_v2;
+    if (area < 0)
+    {
+        std::swap(p1, p2);
+        std::swap(v1, v2);
+        area = -area;
+    }
+
+    // Bounding box in whole pixels, clipped to the target
+    int64_t min_x = std::min({p0.x, p1.x, p2.x}), max_x = std::max({p0.x, p1.x, p2.x});
+    int64_t min_y = std::min({p0.y, p1.y, p2.y}), max_y = std::max({p0.y, p1.y, p2.y});
+    int x_begin = (int)std::max<int64_t>(target.clip_left, min_x >> RASTER_SUBPIXEL_BITS);
+    int y_begin = (int)std::max<int64_t>(target.clip_top, min_y >> RASTER_SUBPIXEL_BITS);
+    int x_end = (int)std::min<int64_t>(target.clip_right, (max_x >> RASTER_SUBPIXEL_BITS) + 1);
+    int y_end = (int)std::min<int64_t>(target.clip_bottom, (max_y >> RASTER_SUBPIXEL_BITS) + 1);
+    if (x_begin >= x_end || y_begin >= y_end)
+        return 0;
+
+    // Pixels on an edge that is not top or left are excluded
+    int64_t bias0 = isTopLeft(p1, p2) ? 0 : 1;
+    int64_t bias1 = isTopLeft(p2, p0) ? 0 : 1;
+    int64_t bias2 = isTopLeft(p0, p1) ? 0 : 1;
+
+    // Edge function increments per pixel step
+    int64_t step_x0 = -(p2.y - p1.y) * SUBPIXEL, step_y0 = (p2.x - p1.x) * SUBPIXEL;
+    int64_t step_x1 = -(p0.y - p2.y) * SUBPIXEL, step_y1 = (p0.x - p2.x) * SUBPIXEL;
+    int64_t step_x2 = -(p1.y - p0.y) * SUBPIXEL, step_y2 = (p1.x - p0.x) * SUBPIXEL;
+
+    // Edge functions at the center of the first pixel
+    int64_t start_x = ((int64_t)x_begin << RASTER_SUBPIXEL_BITS) + SUBPIXEL / 2;
+    int64_t start_y = ((int64_t)y_begin << RASTER_SUBPIXEL_BITS) + SUBPIXEL / 2;
+    int64_t row0 = edge(p1, p2, start_x, start_y);
+    int64_t row1 = edge(p2, p0, start_x, start_y);
+    int64_t row2 = edge(p0, p1, start_x, start_y);
+
+    // Attributes relative to v0, weighted by the barycentric coordinates of v1 and v2
+    float inv_area = 1.0f / (float)area;
+    float dz1 = v1->z - v0.z, dz2 = v2->z - v0.z;
+    float r0 = qRed(v0.color), g0 = qGreen(v0.color), b0 = qBlue(v0.color);
+    float dr1 = qRed(v1->color) - r0, dr2 = qRed(v2->color) - r0;
+    float dg1 = qGreen(v1->color) - g0, dg2 = qGreen(v2->color) - g0;
+    float db1 = qBlue(v1->color) - b0, db2 = qBlue(v2->color) - b0;
+    bool flat = v0.color == v1->color && v0.color == v2->color;
+    uint8_t generation = target.depth->generation();
+
+    size_t covered = 0;
+    for (int y = y_begin; y < y_end; y++)
+    {
+        QRgb *pixels = reinterpret_cast<QRgb *>(target.data + (size_t)y * target.bytes_per_line);
+        float *depth = target.depth->values(y);
+        uint8_t *tags = target.depth->tags(y);
+
+        int64_t w0 = row0, w1 = row1, w2 = row2;
+        for (int x = x_begin; x < x_end; x++)
+        {
+            if (w0 >= bias0 && w1 >= bias1 && w2 >= bias2)
+            {
+                covered++;
+                // Derived from the exact edge functions, so a pixel gets the same
+                // value whichever part of the triangle is being rasterized
+                float l1 = w1 * inv_area, l2 = w2 * inv_area;
+                float z = v0.z + l1 * dz1 + l2 * dz2;
+                if (tags[x] != generation || depth[x] <= z)
+                {
+                    depth[x] = z;
+                    tags[x] = generation;
+                    pixels[x] = flat ? (v0.color | 0xff000000u)
+                                     : qRgb(channel(r0 + l1 * dr1 + l2 * dr2),
+                                            channel(g0 + l1 * dg1 + l2 * dg2),
+                                            channel(b0 + l1 * db1 + l2 * db2));
+                }
+            }
+            w0 += step_x0;
+            w1 += step_x1;
+            w2 += step_x2;
+        }
+
+        row0 += step_y0;
+        row1 += step_y1;
+        row2 += step_y2;
+    }
+    return covered;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QColor>
+#include <cstddef>
+#include "DepthBuffer.h"
+
+// Pixels and depth values the rasterizer writes into. Only pixels with
+// clip_left <= x < clip_right and clip_top <= y < clip_bottom are touched.
+struct RasterTarget
+{
+    unsigned char *data;  // Format_ARGB32 pixels
+    int bytes_per_line;
+    DepthBuffer *depth;   // same size as the image
+    int clip_left, clip_top, clip_right, clip_bottom;
+};
+
+struct RasterVertex
+{
+    float x, y, z;
+    QRgb color;
+};
+
+// Fills a triangle using incremental edge functions over its bounding box.
+//
+// Vertices are snapped to RASTER_SUBPIXEL_BITS of sub-pixel precision and the
+// pixel centers (x + 0.5, y + 0.5) are tested against all three edges. Pixels
+// exactly on an edge belong to the triangle only if that edge is a top or left
+// edge, so triangles sharing an edge never write the same pixel twice.
+// Depth and color are interpolated with barycentric coordinates taken from the
+// edge functions, so a pixel's value does not depend on the clip rectangle and
+// a triangle drawn tile by tile gives the same image. A pixel is written when
+// its depth is not behind the stored one.
+//
+// Returns the number of pixels covered by the triangle.
+size_t rasterizeTriangle(const RasterTarget &target, const RasterVertex &v0, const RasterVertex &v1, const RasterVertex &v2);
+
+const int RASTER_SUBPIXEL_BITS = 8;
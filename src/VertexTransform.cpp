@@ -0,0 +1,74 @@
+#include "VertexTransform.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define DEM_TRANSFORM_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DEM_TRANSFORM_SSE
+#endif
+
+#if defined(DEM_TRANSFORM_AVX)
+static inline __m256 dot4(__m256 x, __m256 y, __m256 z, const float *m, int row)
+{
+    // Same evaluation order as transformPoint(). The lanes only round like the
+    // scalar tail while the compiler leaves it unfused: with FMA available
+    // (DEM_ENABLE_AVX2, -ffp-contract=fast) the tail may differ in the last bit
+    __m256 r = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(m[row])), _mm256_mul_ps(y, _mm256_set1_ps(m[4 + row])));
+    r = _mm256_add_ps(r, _mm256_mul_ps(z, _mm256_set1_ps(m[8 + row])));
+    return _mm256_add_ps(r, _mm256_set1_ps(m[12 + row]));
+}
+#elif defined(DEM_TRANSFORM_SSE)
+static inline __m128 dot4(__m128 x, __m128 y, __m128 z, const float *m, int row)
+{
+    __m128 r = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m[row])), _mm_mul_ps(y, _mm_set1_ps(m[4 + row])));
+    r = _mm_add_ps(r, _mm_mul_ps(z, _mm_set1_ps(m[8 + row])));
+    return _mm_add_ps(r, _mm_set1_ps(m[12 + row]));
+}
+#endif
+
+void transformPoints(const float *m, const float *x, const float *y, const float *z,
+                     float *out_x, float *out_y, float *out_z, size_t n)
+{
+    size_t i = 0;
+
+#if defined(DEM_TRANSFORM_AVX)
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1);
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 px = _mm256_loadu_ps(x + i);
+        __m256 py = _mm256_loadu_ps(y + i);
+        __m256 pz = _mm256_loadu_ps(z + i);
+
+        __m256 w = dot4(px, py, pz, m, 3);
+        w = _mm256_blendv_ps(w, one, _mm256_cmp_ps(w, zero, _CMP_EQ_OQ));
+
+        _mm256_storeu_ps(out_x + i, _mm256_div_ps(dot4(px, py, pz, m, 0), w));
+        _mm256_storeu_ps(out_y + i, _mm256_div_ps(dot4(px, py, pz, m, 1), w));
+        _mm256_storeu_ps(out_z + i, _mm256_div_ps(dot4(px, py, pz, m, 2), w));
+    }
+#elif defined(DEM_TRANSFORM_SSE)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1);
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 px = _mm_loadu_ps(x + i);
+        __m128 py = _mm_loadu_ps(y + i);
+        __m128 pz = _mm_loadu_ps(z + i);
+
+        __m128 w = dot4(px, py, pz, m, 3);
+        __m128 is_zero = _mm_cmpeq_ps(w, zero);
+        w = _mm_or_ps(_mm_and_ps(is_zero, one), _mm_andnot_ps(is_zero, w));
+
+        _mm_storeu_ps(out_x + i, _mm_div_ps(dot4(px, py, pz, m, 0), w));
+        _mm_storeu_ps(out_y + i, _mm_div_ps(dot4(px, py, pz, m, 1), w));
+        _mm_storeu_ps(out_z + i, _mm_div_ps(dot4(px, py, pz, m, 2), w));
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        transformPoint(m, x[i], y[i], z[i], out_x[i], out_y[i], out_z[i]);
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+
+// Fused vertex transform: applies one 4x4 matrix (column-major, as returned by
+// QMatrix4x4::constData()) to points stored as separate x, y, z arrays and
+// divides the result by w. Points with w == 0 are left undivided.
+//
+// Uses AVX when the compiler targets it (see DEM_ENABLE_AVX2 in CMakeLists.txt),
+// SSE on x86-64, and plain scalar code elsewhere.
+void transformPoints(const float *matrix, const float *x, const float *y, const float *z,
+                     float *out_x, float *out_y, float *out_z, size_t n);
+
+inline void transformPoint(const float *m, float x, float y, float z, float &out_x, float &out_y, float &out_z)
+{
+    float w = m[3] * x + m[7] * y + m[11] * z + m[15];
+    if (w == 0)
+        w = 1;
+    out_x = (m[0] * x + m[4] * y + m[8] * z + m[12]) / w;
+    out_y = (m[1] * x + m[5] * y + m[9] * z + m[13]) / w;
+    out_z = (m[2] * x + m[6] * y + m[10] * z + m[14]) / w;
+}
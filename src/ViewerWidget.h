@@ -1,74 +1,49 @@
 #pragma once
 #include <QtWidgets>
 
-#include <float.h>
-#include "ObjectRepresentation.h"
-
-struct Camera
-{
-    QVector3D position;
-    double zenit;
-    double azimuth;
-    double center_of_projection;
-};
-
-struct LightSource
-{
-    QVector3D position;
-    QColor color;
-    int intensity;
-};
-
-struct LightModel
-{
-    QColor ambient_color;
-    QVector3D ambient;
-    QVector3D diffuse;
-    QVector3D specular;
-    double specular_sharpness;
-};
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "Renderer.h"
 
 class ViewerWidget : public QWidget
 {
     Q_OBJECT
 public:
-    enum ColoringType
-    {
-        WIREFRAME,
-        SIDE,
-        VERTEX
-    };
-    enum RasterizationAlgorithm
-    {
-        DDA,
-        BRESENHAMM
-    };
+    typedef Renderer::ColoringType ColoringType;
+    typedef Renderer::RasterizationAlgorithm RasterizationAlgorithm;
+    typedef Renderer::SceneState SceneState;
 
 private:
     QSize areaSize = QSize(0, 0);
-    QImage *img = nullptr;
-    QPainter *painter = nullptr;
-    uchar *data = nullptr;
-    double *z_index = nullptr;
-
-    QColor globalColor;
-    RasterizationAlgorithm rasterizationAlgorithm = DDA;
-    ColoringType coloringType = WIREFRAME;
 
-    // Object
-    ThreeDObject object;
-    double z_scale;
+    // Frames are rendered by a separate thread into the renderer's image and
+    // shown from front_img. The GUI thread edits scene and posts a copy of it
+    // with redraw(); requests that arrive while a frame is being rendered
+    // replace each other, so only the latest one is drawn next.
+    Renderer renderer; // render thread only, meshes edited while it is idle (see waitForFrame())
+    QImage front_img;  // last finished frame, guarded by render_mutex
+    CullingStats stats; // of front_img, guarded by render_mutex
+
+    SceneState scene; // GUI thread only
+    SceneState frame; // copy being rendered, render thread only
+
+    std::thread render_thread;
+    std::mutex render_mutex;
+    std::condition_variable render_wake, frame_done;
+    SceneState requested_scene;
+    bool frame_requested = false;
+    bool rendering = false;
+    bool stop_rendering = false;
 
     // Camera
-    Camera camera;
     bool isCameraRotating = false;
+    bool isCameraPanning = false;
     QPointF last_mouse_pos;
 
-    // Light source
-    LightSource lightSource;
-
-    // Light model
-    LightModel lightModel;
+    void renderLoop();
+    void swapImages();
 
 public:
     ViewerWidget(QSize imgSize, QWidget *parent = Q_NULLPTR);
@@ -76,150 +51,150 @@ public:
     void resizeWidget(QSize size);
 
     void setGlobalColor(QColor color);
-    QColor getGlobalColor() { return globalColor; }
+    QColor getGlobalColor() { return scene.globalColor; }
     void setColoringType(ColoringType type)
     {
-        clear();
-        coloringType = type;
-        drawObject();
+        scene.coloringType = type;
+        redraw();
+    }
+    ColoringType getColoringType() { return scene.coloringType; }
+    void setRasterizationAlgorithm(RasterizationAlgorithm algorithm)
+    {
+        scene.rasterizationAlgorithm = algorithm;
+        redraw();
+    }
+    RasterizationAlgorithm getRasterizationAlgorithm() { return scene.rasterizationAlgorithm; }
+    void setThreadCount(int threads)
+    {
+        waitForFrame();
+        renderer.setThreadCount(threads);
+        redraw();
+    }
+    int getThreadCount() { return renderer.threadCount(); }
+    void setStageCaching(bool enabled)
+    {
+        waitForFrame();
+        renderer.setStageCaching(enabled);
+        redraw();
     }
-    ColoringType getColoringType() { return coloringType; }
-    void setRasterizationAlgorithm(RasterizationAlgorithm algorithm) { rasterizationAlgorithm = algorithm; }
-    RasterizationAlgorithm getRasterizationAlgorithm() { return rasterizationAlgorithm; }
+    bool getStageCaching() { return renderer.stageCaching(); }
+    void setOcclusionCulling(bool enabled)
+    {
+        scene.occlusion_culling = enabled;
+        redraw();
+    }
+    bool getOcclusionCulling() { return scene.occlusion_culling; }
+    void setBackfaceCulling(bool enabled)
+    {
+        scene.backface_culling = enabled;
+        redraw();
+    }
+    bool getBackfaceCulling() { return scene.backface_culling; }
+    void setLodTolerance(double pixels)
+    {
+        scene.lod_tolerance = pixels;
+        redraw();
+    }
+    double getLodTolerance() { return scene.lod_tolerance; }
+    CullingStats getCullingStats(); // of the last finished frame
 
     // Image functions
     bool setImage(const QImage &inputImg);
-    QImage *getImage() { return img; };
+    QImage *getImage(); // last finished frame
     bool isEmpty();
     bool changeSize(int width, int height);
 
-    // void setPixel(int x, int y, uchar r, uchar g, uchar b, uchar a = 255);
-    // void setPixel(int x, int y, double valR, double valG, double valB, double valA = 1.);
-    void setPixel(int x, int y, float z, const QColor &color);
-    void setPixel(QVector3D point, const QColor &color) { setPixel(point.x() + 0.5, point.y() + 0.5, point.z(), color); }
-    void setPixel(Vertex vertex) { setPixel(vertex.x, vertex.y, vertex.z, vertex.color); }
-    bool isInside(int x, int y) { return (x >= 10 && y >= 10 && x < img->width() - 10 && y < img->height() - 10) ? true : false; }
-    bool isInside(QPoint point) { return isInside(point.x(), point.y()); }
-    bool isInside(Vertex vertex) { return isInside(vertex.x, vertex.y); }
-    bool isPolygonInside(std::list<Vertex> polygon);
-
     //// 3D Object ////
-    void debugObject(ThreeDObject &object);
-    void loadObject(std::vector<QVector3D> vertices, std::vector<std::vector<unsigned int>> polygons);
+    void loadObject(const std::vector<QVector3D> &vertices, const std::vector<std::vector<unsigned int>> &polygons);
+    void loadHeightfield(const std::vector<QVector3D> &points, int rows, int cols);
+    // Regular grid, its vertex positions computed from the spacing
+    void loadHeightfield(const HeightGrid &heights);
     void translateObject(QVector3D offset);
+    // Draws a terrain streamed from disk, nullptr stops streaming
+    void loadStreamedTerrain(std::shared_ptr<TerrainStreamer> terrain);
     void scaleObject(double scale)
     {
-        object.scale(scale);
-        camera.position *= scale;
+        scene.object_scale *= scale;
+        scene.camera.position *= scale;
         redraw();
     }
     void scaleZCoordinates(double scale);
     void setZScale(double scale)
     {
-        z_scale = scale;
+        scene.z_scale = scale;
         redraw();
     }
 
     //// Camera ////
     void setCamera(QVector3D position, double center_of_projection)
     {
-        camera.position = position;
-        camera.center_of_projection = center_of_projection;
-        clear();
-        drawObject();
+        scene.camera.position = position;
+        scene.camera.center_of_projection = center_of_projection;
+        redraw();
     }
     void setCameraRotation(double zenith, double azimuth)
     {
-        camera.zenit = zenith;
-        camera.azimuth = azimuth;
-        clear();
-        drawObject();
+        scene.camera.zenit = zenith;
+        scene.camera.azimuth = azimuth;
+        redraw();
     }
     void setIsCameraRotating(bool isRotating) { isCameraRotating = isRotating; }
     bool getIsCameraRotating() { return isCameraRotating; }
     void setLastMousePos(QPointF pos) { last_mouse_pos = pos; }
     void rotateCamera(QPointF mouse_pos);
+    void setIsCameraPanning(bool isPanning) { isCameraPanning = isPanning; }
+    bool getIsCameraPanning() { return isCameraPanning; }
+    void panCamera(QPointF mouse_pos);
 
     //// Light ////
     void setLightPositionX(double x)
     {
-        lightSource.position.setX(x);
+        scene.lightSource.position.setX(x);
         redraw();
     }
     void setLightPositionY(double y)
     {
-        lightSource.position.setY(y);
+        scene.lightSource.position.setY(y);
         redraw();
     }
     void setLightPositionZ(double z)
     {
-        lightSource.position.setZ(z);
+        scene.lightSource.position.setZ(z);
         redraw();
     }
     void setLightColor(QColor color)
     {
-        lightSource.color = color;
+        scene.lightSource.color = color;
         redraw();
     }
     void setLightIntensity(int intensity);
-    QColor getLightColor() { return lightSource.color; }
+    QColor getLightColor() { return scene.lightSource.color; }
 
     //// Light model ////
-    LightModel &getLightModel() { return lightModel; }
+    LightModel &getLightModel() { return scene.lightModel; } // call redraw() after changing it
     void printLightModel()
     {
+        const LightModel &lightModel = scene.lightModel;
         qDebug() << "Light model:" << lightModel.ambient << lightModel.diffuse << lightModel.specular << lightModel.specular_sharpness
                  << lightModel.ambient_color;
     }
 
-    //// Drawing ////
-
-    // Line
-    void drawLine(Vertex start, Vertex end);
-
-    void Dda(Vertex start, Vertex end);
-    void Dda_x(Vertex start, Vertex end, double m);
-    void Dda_y(Vertex start, Vertex end, double w);
-
-    void Bresenhamm(Vertex start, Vertex end);
-    void Bresenhamm_x(Vertex start, Vertex end, double m);
-    void Bresenhamm_y(Vertex start, Vertex end, double m);
-
-    // Polygon
-    // void drawPolygon(std::list<Vertex> polygon) { drawPolygon(polygon, globalColor); }
-    void drawPolygon(std::list<Vertex> polygon, QColor color);
-    void drawPolygon(std::list<Vertex> polygon);
-    void fillPolygon(std::list<Vertex> polygon);
-    void fillTriangle(std::vector<Vertex> polygon);
-
-    // 3D Object
-    void drawObject() { drawObject(object, camera, lightSource, coloringType); }
-    void drawObject(ThreeDObject obj, Camera camera, LightSource light, ColoringType coloring);
-    void transformToViewingCoordinates(ThreeDObject &object, Camera camera);
-    void calculateColors(ThreeDObject &object, LightSource light, Camera camera, ColoringType coloring);
-    void transformToPerspectiveCoordinates(ThreeDObject &object, double center_of_projection);
-    void drawObject(ThreeDObject *object, ColoringType coloring);
-
-    //// Clipping ////
-
-    // Cyrus-Beck
-    void clipLine(Vertex start, Vertex end, Vertex &clip_start, Vertex &clip_end);
-
-    // Sutherland-Hodgman
-    void clipPolygonLeftSide(std::list<Vertex> &polygon, int x_min);
-    void clipPolygon(std::list<Vertex> &polygon);
+    void delete_objects();
 
-    // Get/Set functions
-    uchar *getData() { return data; }
-    void setDataPtr() { data = img->bits(); }
-    void setPainter() { painter = new QPainter(img); }
+    //// Profiler ////
+    void setProfilerOverlay(bool visible); // stage times drawn over the frames
+    void startTrace();
+    void stopTrace();
+    bool saveTrace(const QString &filename); // frames of the last trace, in the Chrome trace format
 
-    int getImgWidth() { return img->width(); };
-    int getImgHeight() { return img->height(); };
+    //// Frames ////
+    void clear();  // shows an empty frame
+    void redraw(); // requests a frame of the current scene
+    void waitForFrame(); // blocks until the requested frames are finished
 
-    void delete_objects();
-    void clear();
-    void redraw();
+signals:
+    void frameReady();
+    void tilesLoaded(); // emitted on the tile loader thread
 
 public slots:
     void paintEvent(QPaintEvent *event) Q_DECL_OVERRIDE;
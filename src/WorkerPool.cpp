@@ -0,0 +1,93 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(int threads)
+{
+    setThreadCount(threads);
+}
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+void WorkerPool::setThreadCount(int threads)
+{
+    if (threads <= 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    if (threads == threadCount())
+        return;
+
+    stop();
+    stopping = false;
+    for (int i = 1; i < threads; i++)
+        workers.emplace_back(&WorkerPool::work, this);
+}
+
+void WorkerPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+    workers.clear();
+}
+
+void WorkerPool::run(size_t count, const std::function<void(size_t job)> &job)
+{
+    if (count == 0)
+        return;
+    if (workers.empty())
+    {
+        for (size_t i = 0; i < count; i++)
+            job(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch = &job;
+        batch_size = count;
+        next_job = 0;
+        finished_jobs = 0;
+    }
+    wake.notify_all();
+    runJobs();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return finished_jobs == batch_size; });
+    batch = nullptr;
+}
+
+void WorkerPool::work()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [this] { return stopping || (batch && next_job < batch_size); });
+        if (stopping)
+            return;
+        lock.unlock();
+        runJobs();
+        lock.lock();
+    }
+}
+
+// Takes jobs of the current batch until none are left
+void WorkerPool::runJobs()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (batch && next_job < batch_size)
+    {
+        size_t job = next_job++;
+        const std::function<void(size_t)> &function = *batch;
+        lock.unlock();
+        function(job);
+        lock.lock();
+        if (++finished_jobs == batch_size)
+            done.notify_all();
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads running numbered jobs.
+//
+// run() hands out the jobs 0 .. count - 1 to the pool and to the calling
+// thread and returns once all of them have finished. The threads are kept
+// alive between calls, so dispatching a batch does not create any.
+class WorkerPool
+{
+public:
+    // 0 threads means one per hardware thread
+    explicit WorkerPool(int threads = 0);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    void setThreadCount(int threads);
+    int threadCount() const { return (int)workers.size() + 1; } // including the calling thread
+
+    // Not reentrant, batches are run one at a time
+    void run(size_t count, const std::function<void(size_t job)> &job);
+
+private:
+    void work();
+    void runJobs();
+    void stop();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+
+    // Current batch, guarded by mutex
+    const std::function<void(size_t)> *batch = nullptr;
+    size_t batch_size = 0;
+    size_t next_job = 0;
+    size_t finished_jobs = 0;
+    bool stopping = false;
+};
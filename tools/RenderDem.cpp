@@ -0,0 +1,229 @@
+// Headless rendering of a terrain into an image file
+//
+// Usage: RenderDem [options] terrain output
+//   Loads a DEM (.dat, .asc or .hgt) like the viewer does, renders a single
+//   frame with the given camera, light and shading and saves it, e.g. as PNG.
+//   Nothing is shown, so it runs without a display. Angles are in degrees,
+//   the light defaults match the viewer's.
+//
+//   With --path camera.txt every frame of a camera path (see CameraPath) is
+//   rendered instead, several frames at once, and output names the files,
+//   the frame number replacing its run of '#', e.g. "flyover/frame_####.png".
+
+#include <QtGui>
+#include <chrono>
+#include <cstdio>
+#include "BatchRenderer.h"
+#include "CameraPath.h"
+#include "DemFile.h"
+#include "Renderer.h"
+#include "RtinMesh.h"
+
+// "x,y,z", used for positions and light model coefficients
+static bool parseVector(const QString &text, QVector3D &vector)
+{
+    QStringList parts = text.split(',');
+    if (parts.size() != 3)
+        return false;
+
+    bool ok[3];
+    vector = QVector3D(parts[0].toDouble(&ok[0]), parts[1].toDouble(&ok[1]), parts[2].toDouble(&ok[2]));
+    return ok[0] && ok[1] && ok[2];
+}
+
+static bool parseSize(const QString &text, QSize &size)
+{
+    QStringList parts = text.split('x');
+    if (parts.size() != 2)
+        return false;
+
+    bool ok_w, ok_h;
+    size = QSize(parts[0].toInt(&ok_w), parts[1].toInt(&ok_h));
+    return ok_w && ok_h && size.width() > 20 && size.height() > 20; // wider than the border isInside() leaves
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("RenderDem");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders a digital elevation model into an image without a window.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("terrain", "Terrain file (.dat, .asc or .hgt).");
+    parser.addPositionalArgument("output", "Image file, its format given by the suffix (e.g. .png); with --path, "
+                                           "its run of '#' is replaced by the frame number.");
+
+    QCommandLineOption sizeOption({"s", "size"}, "Image size.", "WxH", "1024x768");
+    QCommandLineOption zenithOption("zenith", "Camera elevation above the horizon.", "degrees", "30");
+    QCommandLineOption azimuthOption("azimuth", "Camera rotation around the vertical axis.", "degrees", "0");
+    QCommandLineOption cameraOption("camera", "Camera position.", "x,y,z", "0,0,0");
+    QCommandLineOption perspectiveOption("perspective", "Distance of the center of projection, 0 for a parallel projection.",
+                                         "distance", "0");
+    QCommandLineOption zoomOption("zoom", "Scale of the terrain fitted to the image.", "factor", "1");
+    QCommandLineOption zScaleOption("z-scale", "Exaggeration of the heights.", "factor", "1");
+    QCommandLineOption lightOption("light", "Position of the point light.", "x,y,z", "0,-200,200");
+    QCommandLineOption lightColorOption("light-color", "Color of the light.", "color", "white");
+    QCommandLineOption intensityOption("intensity", "Light intensity, 0 to 255.", "value", "50");
+    QCommandLineOption ambientOption("ambient", "Ambient reflection coefficients.", "r,g,b", "0.5,0.5,0.5");
+    QCommandLineOption diffuseOption("diffuse", "Diffuse reflection coefficients.", "r,g,b", "0.5,0.5,0.5");
+    QCommandLineOption specularOption("specular", "Specular reflection coefficients.", "r,g,b", "0.5,0.5,0.5");
+    QCommandLineOption sharpnessOption("sharpness", "Specular sharpness.", "value", "1");
+    QCommandLineOption coloringOption("coloring", "wireframe, side (flat) or vertex (Gouraud).", "type", "vertex");
+    QCommandLineOption rasterizerOption("rasterizer", "dda, bresenham or edge (edge functions, multithreaded).", "algorithm", "edge");
+    QCommandLineOption colorOption("color", "Color of the terrain where its height gives none.", "color", "blue");
+    QCommandLineOption threadsOption("threads", "Rasterizer threads, 0 for all hardware threads.", "count", "0");
+    QCommandLineOption lodOption("lod", "Largest screen error of simplified chunks.", "pixels", "1");
+    QCommandLineOption rtinOption("rtin", "Draw an RTIN mesh with this largest height error instead of the grid.", "error");
+    QCommandLineOption noOcclusionOption("no-occlusion-culling", "Draw chunks hidden behind nearer terrain.");
+    QCommandLineOption noBackfaceOption("no-backface-culling", "Draw faces turned away from the camera.");
+    QCommandLineOption pathOption("path", "Render every frame of a camera path file.", "file");
+    QCommandLineOption jobsOption("jobs", "Frames rendered at once with --path, 0 for one per hardware thread.", "count", "0");
+    QCommandLineOption saversOption("savers", "Threads writing the frames with --path.", "count", "2");
+    parser.addOptions({sizeOption, zenithOption, azimuthOption, cameraOption, perspectiveOption, zoomOption, zScaleOption,
+                       lightOption, lightColorOption, intensityOption, ambientOption, diffuseOption, specularOption,
+                       sharpnessOption, coloringOption, rasterizerOption, colorOption, threadsOption, lodOption,
+                       rtinOption, noOcclusionOption, noBackfaceOption, pathOption, jobsOption, saversOption});
+    parser.process(app);
+
+    QStringList files = parser.positionalArguments();
+    if (files.size() != 2)
+    {
+        std::fprintf(stderr, "Expected a terrain and an output file, see --help\n");
+        return 1;
+    }
+
+    // Scene
+    Renderer::SceneState scene;
+    QSize size;
+    bool ok = parseSize(parser.value(sizeOption), size);
+    Camera &camera = scene.camera;
+    camera.zenit = qDegreesToRadians(parser.value(zenithOption).toDouble());
+    camera.azimuth = qDegreesToRadians(parser.value(azimuthOption).toDouble());
+    ok = ok && parseVector(parser.value(cameraOption), camera.position);
+    camera.center_of_projection = parser.value(perspectiveOption).toDouble();
+    scene.object_scale = parser.value(zoomOption).toDouble();
+    camera.position *= scene.object_scale; // as zooming in the viewer moves it
+    scene.z_scale = parser.value(zScaleOption).toDouble();
+
+    LightSource &light = scene.lightSource;
+    ok = ok && parseVector(parser.value(lightOption), light.position);
+    light.color = QColor(parser.value(lightColorOption));
+    light.intensity = qBound(0, parser.value(intensityOption).toInt(), 255);
+    LightModel &model = scene.lightModel;
+    model.ambient_color = Qt::white;
+    ok = ok && parseVector(parser.value(ambientOption), model.ambient) &&
+         parseVector(parser.value(diffuseOption), model.diffuse) &&
+         parseVector(parser.value(specularOption), model.specular);
+    model.specular_sharpness = parser.value(sharpnessOption).toDouble();
+    scene.globalColor = QColor(parser.value(colorOption));
+    if (!ok || !light.color.isValid() || !scene.globalColor.isValid())
+    {
+        std::fprintf(stderr, "Invalid option value, see --help\n");
+        return 1;
+    }
+
+    QString coloring = parser.value(coloringOption).toLower();
+    if (coloring == "wireframe")
+        scene.coloringType = Renderer::WIREFRAME;
+    else if (coloring == "side")
+        scene.coloringType = Renderer::SIDE;
+    else if (coloring == "vertex")
+        scene.coloringType = Renderer::VERTEX;
+    else
+    {
+        std::fprintf(stderr, "Unknown coloring %s\n", qPrintable(coloring));
+        return 1;
+    }
+    QString rasterizer = parser.value(rasterizerOption).toLower();
+    if (rasterizer == "dda")
+        scene.rasterizationAlgorithm = Renderer::DDA;
+    else if (rasterizer == "bresenham")
+        scene.rasterizationAlgorithm = Renderer::BRESENHAMM;
+    else if (rasterizer == "edge")
+        scene.rasterizationAlgorithm = Renderer::EDGE_FUNCTION;
+    else
+    {
+        std::fprintf(stderr, "Unknown rasterizer %s\n", qPrintable(rasterizer));
+        return 1;
+    }
+    scene.lod_tolerance = parser.value(lodOption).toDouble();
+    scene.occlusion_culling = !parser.isSet(noOcclusionOption);
+    scene.backface_culling = !parser.isSet(noBackfaceOption);
+
+    CameraPath path;
+    if (parser.isSet(pathOption))
+    {
+        if (!path.load(parser.value(pathOption)))
+        {
+            std::fprintf(stderr, "Cannot read %s: %s\n", qPrintable(parser.value(pathOption)), qPrintable(path.errorString()));
+            return 1;
+        }
+        if (!files[1].contains('#'))
+        {
+            std::fprintf(stderr, "The output of a camera path needs '#' for the frame number\n");
+            return 1;
+        }
+    }
+
+    // Terrain
+    DemFile dem;
+    if (!dem.open(files[0]))
+    {
+        std::fprintf(stderr, "Cannot read %s: %s\n", qPrintable(files[0]), qPrintable(dem.errorString()));
+        return 1;
+    }
+
+    Renderer renderer(size);
+    if (int threads = parser.value(threadsOption).toInt())
+        renderer.setThreadCount(threads);
+    renderer.setGlobalColor(scene.globalColor);
+    if (parser.isSet(rtinOption))
+    {
+        RtinMesh rtin;
+        if (!rtin.build(dem.grid()))
+        {
+            std::fprintf(stderr, "An RTIN mesh needs a square grid of 2^n+1 vertices per side\n");
+            return 1;
+        }
+        std::vector<QVector3D> vertices;
+        std::vector<std::vector<unsigned int>> triangles;
+        rtin.triangulate(parser.value(rtinOption).toDouble(), vertices, triangles);
+        renderer.loadObject(vertices, triangles);
+    }
+    else
+        renderer.loadHeightfield(dem.grid());
+
+    if (!path.isEmpty())
+    {
+        BatchRenderer batch(parser.value(jobsOption).toInt(), parser.value(saversOption).toInt());
+        BatchStats stats = batch.render(renderer, scene, path, files[1]);
+        double frame_ms = 1e3 / stats.frames;
+        std::printf("%d frames in %.2f s, %.1f frames/s (%d render threads, %d save threads)\n", stats.frames, stats.seconds,
+                    stats.frames / stats.seconds, batch.renderThreads(), batch.saveThreads());
+        std::printf("  render %8.2f ms/frame\n", stats.render_seconds * frame_ms);
+        std::printf("  save   %8.2f ms/frame\n", stats.save_seconds * frame_ms);
+        std::printf("  stall  %8.2f ms/frame (renderers waiting to queue a frame for saving)\n", stats.stall_seconds * frame_ms);
+        if (stats.failed > 0)
+        {
+            std::fprintf(stderr, "%d frames could not be written\n", stats.failed);
+            return 1;
+        }
+        return 0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    renderer.render(scene);
+    auto end = std::chrono::steady_clock::now();
+
+    if (!renderer.image().save(files[1]))
+    {
+        std::fprintf(stderr, "Cannot write %s\n", qPrintable(files[1]));
+        return 1;
+    }
+
+    const CullingStats &stats = renderer.stats();
+    std::printf("%s: %dx%d grid, %dx%d image, %zu faces drawn, %.2f ms\n", qPrintable(files[1]), dem.rows(), dem.cols(),
+                size.width(), size.height(), stats.faces_drawn, std::chrono::duration<double, std::milli>(end - start).count());
+    return 0;
+}
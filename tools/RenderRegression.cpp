@@ -0,0 +1,257 @@
+// Golden-image and frame-time regression check of the rasterizers
+//
+// Usage: RenderRegression [options] [terrain ...]
+//   Renders every terrain (default: data/SK_*.dat and data/Himalaje_*.dat)
+//   headless in each combination of coloring (wireframe, side, vertex),
+//   line and fill algorithm (DDA, Bresenham) and projection (parallel,
+//   perspective), and compares the images with the references in the
+//   golden directory. A frame differs when more than --max-differing pixels
+//   have a color channel more than --tolerance apart. Frame times are the
+//   median of --runs renders; a scenario fails when it is more than
+//   --max-slowdown percent slower than its reference time, unless that was
+//   under --min-time.
+//
+//   --update renders the references, images and times, instead. The images
+//   in data/golden are meant to be versioned: rendered with one thread, they
+//   come out the same on any machine but for a few edge pixels where the
+//   compiler rounds differently. Record them with a Qt 6 build and commit
+//   them once the render_regression test passes on it. The times
+//   (times.json, not versioned) are only comparable on the machine and build
+//   type they were recorded on, record them there with --update; --no-timing
+//   keeps them. Exits with 1 if any scenario failed; the images of failed
+//   frames are written to the --failures directory.
+
+#include <QtGui>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include "DemFile.h"
+#include "Renderer.h"
+
+struct Scenario
+{
+    QString name;
+    Renderer::ColoringType coloring;
+    Renderer::RasterizationAlgorithm algorithm;
+    double center_of_projection; // 0 for a parallel projection
+};
+
+static std::vector<Scenario> scenarios()
+{
+    std::vector<Scenario> result;
+    const std::pair<Renderer::ColoringType, const char *> colorings[] = {
+        {Renderer::WIREFRAME, "wireframe"}, {Renderer::SIDE, "side"}, {Renderer::VERTEX, "vertex"}};
+    const std::pair<Renderer::RasterizationAlgorithm, const char *> algorithms[] = {
+        {Renderer::DDA, "dda"}, {Renderer::BRESENHAMM, "bresenham"}};
+    const std::pair<double, const char *> projections[] = {{0, "parallel"}, {300, "perspective"}};
+
+    for (const auto &coloring : colorings)
+        for (const auto &algorithm : algorithms)
+            for (const auto &projection : projections)
+                result.push_back({QString(coloring.second) + "_" + algorithm.second + "_" + projection.second,
+                                  coloring.first, algorithm.first, projection.first});
+    return result;
+}
+
+// Camera and light as the viewer starts with them, turned to see the relief
+static Renderer::SceneState baseScene()
+{
+    Renderer::SceneState scene;
+    scene.globalColor = Qt::blue;
+    scene.camera = {QVector3D(0, 0, 0), qDegreesToRadians(30.0), qDegreesToRadians(30.0), 0};
+    scene.lightSource.position = QVector3D(0, -200, 200);
+    scene.lightSource.color = Qt::white;
+    scene.lightSource.intensity = 50;
+    scene.lightModel.ambient_color = Qt::white;
+    scene.lightModel.ambient = scene.lightModel.diffuse = scene.lightModel.specular = QVector3D(0.5, 0.5, 0.5);
+    scene.lightModel.specular_sharpness = 1;
+    return scene;
+}
+
+// Pixels with a channel more than tolerance apart, -1 if the sizes differ
+static qint64 differingPixels(const QImage &a, const QImage &b, int tolerance)
+{
+    if (a.size() != b.size())
+        return -1;
+
+    QImage first = a.convertToFormat(QImage::Format_ARGB32), second = b.convertToFormat(QImage::Format_ARGB32);
+    qint64 count = 0;
+    for (int y = 0; y < first.height(); y++)
+    {
+        const QRgb *p = reinterpret_cast<const QRgb *>(first.constScanLine(y));
+        const QRgb *q = reinterpret_cast<const QRgb *>(second.constScanLine(y));
+        for (int x = 0; x < first.width(); x++)
+        {
+            int difference = std::max({std::abs(qRed(p[x]) - qRed(q[x])), std::abs(qGreen(p[x]) - qGreen(q[x])),
+                                       std::abs(qBlue(p[x]) - qBlue(q[x])), std::abs(qAlpha(p[x]) - qAlpha(q[x]))});
+            count += difference > tolerance;
+        }
+    }
+    return count;
+}
+
+// Median time of runs renders, in ms
+static double frameTime(Renderer &renderer, const Renderer::SceneState &scene, int runs)
+{
+    renderer.render(scene); // warm-up, sizes the buffers
+    std::vector<double> times;
+    for (int i = 0; i < runs; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        renderer.render(scene);
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("RenderRegression");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Compares headless renders with reference images and frame times.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("terrain", "Terrain files, by default the SK and Himalaje grids in data/.", "[terrain ...]");
+
+    QCommandLineOption goldenOption("golden", "Directory of the reference images and times.", "dir", "data/golden");
+    QCommandLineOption updateOption("update", "Record the references instead of checking against them.");
+    QCommandLineOption sizeOption({"s", "size"}, "Image size.", "WxH", "640x480");
+    QCommandLineOption toleranceOption("tolerance", "Largest difference of a color channel still counted as equal.", "value", "2");
+    QCommandLineOption differingOption("max-differing", "Pixels allowed to differ per frame.", "count", "0");
+    QCommandLineOption runsOption("runs", "Renders timed per scenario, the median is compared.", "count", "5");
+    QCommandLineOption slowdownOption("max-slowdown", "Allowed increase of the frame time.", "percent", "25");
+    QCommandLineOption minTimeOption("min-time", "Reference times below this are not checked, too noisy.", "ms", "1");
+    QCommandLineOption noTimingOption("no-timing", "Compare the images only.");
+    QCommandLineOption failuresOption("failures", "Directory for the images of failed frames.", "dir", "render_failures");
+    parser.addOptions({goldenOption, updateOption, sizeOption, toleranceOption, differingOption, runsOption,
+                       slowdownOption, minTimeOption, noTimingOption, failuresOption});
+    parser.process(app);
+
+    QStringList files = parser.positionalArguments();
+    if (files.isEmpty())
+    {
+        QDir data("data");
+        for (const QString &file : data.entryList(QStringList() << "SK_*.dat" << "Himalaje_*.dat", QDir::Files))
+            files << data.filePath(file);
+    }
+    if (files.isEmpty())
+    {
+        std::fprintf(stderr, "No terrains given and none found in data/\n");
+        return 1;
+    }
+
+    QStringList size_parts = parser.value(sizeOption).split('x');
+    QSize size = size_parts.size() == 2 ? QSize(size_parts[0].toInt(), size_parts[1].toInt()) : QSize();
+    if (size.width() <= 20 || size.height() <= 20)
+    {
+        std::fprintf(stderr, "Invalid image size, see --help\n");
+        return 1;
+    }
+    bool update = parser.isSet(updateOption);
+    bool timing = !parser.isSet(noTimingOption);
+    int tolerance = parser.value(toleranceOption).toInt();
+    qint64 max_differing = parser.value(differingOption).toLongLong();
+    int runs = std::max(1, parser.value(runsOption).toInt());
+    double max_slowdown = parser.value(slowdownOption).toDouble() / 100;
+    double min_time = parser.value(minTimeOption).toDouble();
+
+    QDir golden(parser.value(goldenOption));
+    QDir failures(parser.value(failuresOption));
+    if (update && !golden.mkpath("."))
+    {
+        std::fprintf(stderr, "Cannot create %s\n", qPrintable(golden.path()));
+        return 1;
+    }
+
+    // Reference frame times by scenario, "<terrain>/<scenario>"
+    QString times_path = golden.filePath("times.json");
+    QJsonObject reference_times;
+    QFile times_file(times_path);
+    if (times_file.open(QIODevice::ReadOnly))
+        reference_times = QJsonDocument::fromJson(times_file.readAll()).object();
+    times_file.close();
+    if (!update && timing && reference_times.isEmpty())
+        std::printf("No reference times in %s, frame times are not checked\n", qPrintable(times_path));
+
+    Renderer renderer(size);
+    renderer.setThreadCount(1);
+    renderer.setStageCaching(false); // every run is timed as a whole frame
+    renderer.setGlobalColor(Qt::blue);
+
+    int checked = 0, failed = 0;
+    std::printf("%-46s %-6s %10s %10s %10s\n", "scenario", "result", "differing", "time [ms]", "reference");
+    for (const QString &filename : files)
+    {
+        DemFile dem;
+        if (!dem.open(filename))
+        {
+            std::printf("%s: %s\n", qPrintable(filename), qPrintable(dem.errorString()));
+            failed++;
+            continue;
+        }
+        renderer.loadHeightfield(dem.grid());
+        QString terrain = QFileInfo(filename).completeBaseName();
+
+        for (const Scenario &scenario : scenarios())
+        {
+            Renderer::SceneState scene = baseScene();
+            scene.coloringType = scenario.coloring;
+            scene.rasterizationAlgorithm = scenario.algorithm;
+            scene.camera.center_of_projection = scenario.center_of_projection;
+
+            QString name = terrain + "/" + scenario.name;
+            QString image_name = terrain + "_" + scenario.name + ".png";
+            double time = timing ? frameTime(renderer, scene, runs) : 0;
+            renderer.render(scene);
+            checked++;
+
+            if (update)
+            {
+                if (!renderer.image().save(golden.filePath(image_name)))
+                {
+                    std::printf("%-46s cannot write %s\n", qPrintable(name), qPrintable(golden.filePath(image_name)));
+                    failed++;
+                    continue;
+                }
+                if (timing)
+                    reference_times[name] = time;
+                std::printf("%-46s %-6s %10s %10.2f\n", qPrintable(name), "saved", "", time);
+                continue;
+            }
+
+            QImage reference(golden.filePath(image_name));
+            qint64 differing = reference.isNull() ? -1 : differingPixels(renderer.image(), reference, tolerance);
+            bool image_ok = differing >= 0 && differing <= max_differing;
+
+            double reference_time = reference_times.value(name).toDouble();
+            bool time_ok = !timing || reference_time < min_time || time <= reference_time * (1 + max_slowdown);
+
+            QString result = !image_ok && !time_ok ? "FAIL" : !image_ok ? "IMAGE" : !time_ok ? "SLOW" : "ok";
+            QString differing_text = reference.isNull() ? "missing" : differing < 0 ? "size" : QString::number(differing);
+            std::printf("%-46s %-6s %10s %10.2f %10.2f\n", qPrintable(name), qPrintable(result), qPrintable(differing_text),
+                        time, reference_time);
+            if (image_ok && time_ok)
+                continue;
+
+            failed++;
+            if (!image_ok && failures.mkpath("."))
+                renderer.image().save(failures.filePath(image_name));
+        }
+    }
+
+    if (update && timing)
+    {
+        times_file.setFileName(times_path);
+        if (!times_file.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+            times_file.write(QJsonDocument(reference_times).toJson()) < 0)
+        {
+            std::fprintf(stderr, "Cannot write %s\n", qPrintable(times_path));
+            return 1;
+        }
+    }
+
+    std::printf("%d scenarios, %d failed\n", checked, failed);
+    return failed > 0 ? 1 : 0;
+}